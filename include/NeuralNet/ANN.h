@@ -5,11 +5,20 @@ runtime-sized ANN, runtime-sized matrix
 #include "Tensor/Tensor.h"
 #include "Common/String.h"	// std::ostream << std::vector<>
 #include "Common/Exception.h"
+#include "NeuralNet/Kernels.h"
+#include "NeuralNet/Conv.h"
+#include "NeuralNet/Sparse.h"
+#include "NeuralNet/Cost.h"
 #include <vector>
+#include <optional>
 #include <functional>
 #include <cassert>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <cstdint>
 
 namespace NeuralNet {
 
@@ -236,6 +245,107 @@ struct ActivationDeriv {
 	}
 };
 
+// canned loss functions
+// f fills yErr = -dLoss/dy, i.e. desired - y for half-squared, and returns the loss, in one pass over the output
+// outputTransform, if set, is applied across the whole output at the end of feedForward
+// if fusedOutput then f already includes the outputTransform's derivative, so the last layer has to be identity / one
+template<typename Real = DefaultReal>
+struct Loss {
+	std::string name;
+	std::function<Real(Real const * y, Real const * desired, Real * yErr, int n)> f;
+	std::function<void(Real * y, int n)> outputTransform;
+	bool fusedOutput = false;
+
+	static Loss halfSquared() {
+		return {
+			"halfSquared",
+			[](Real const * y, Real const * desired, Real * yErr, int n) -> Real {
+				Real s = {};
+				for (int i = 0; i < n; ++i) {
+					auto const delta = desired[i] - y[i];
+					yErr[i] = delta;
+					s += delta * delta;
+				}
+				return Real(.5) * s;
+			},
+			{},
+			false,
+		};
+	}
+
+	// half-squared inside ±delta, linear outside, so the gradient is the error clamped to ±delta
+	static Loss huber(Real delta = 1) {
+		return {
+			"huber",
+			[delta](Real const * y, Real const * desired, Real * yErr, int n) -> Real {
+				Real s = {};
+				for (int i = 0; i < n; ++i) {
+					auto const r = desired[i] - y[i];
+					auto const clipped = std::clamp<Real>(r, -delta, delta);
+					yErr[i] = clipped;
+					// = .5 r^2 inside, delta (|r| - .5 delta) outside
+					s += clipped * (r - Real(.5) * clipped);
+				}
+				return s;
+			},
+			{},
+			false,
+		};
+	}
+
+	// y = softmax(net), loss = -sum desired log y
+	// dLoss/dnet = y - desired, so the softmax jacobian never gets built
+	static Loss softmaxCrossEntropy() {
+		return {
+			"softmaxCrossEntropy",
+			[](Real const * y, Real const * desired, Real * yErr, int n) -> Real {
+				Real s = {};
+				for (int i = 0; i < n; ++i) {
+					yErr[i] = desired[i] - y[i];
+					// one-hot targets skip the log for all but one
+					if (desired[i] != Real()) {
+						s -= desired[i] * std::log(std::max(y[i], std::numeric_limits<Real>::min()));
+					}
+				}
+				return s;
+			},
+			[](Real * y, int n) {
+				// subtract the max so exp() can't overflow
+				Real maxY = y[0];
+				for (int i = 1; i < n; ++i) {
+					maxY = std::max(maxY, y[i]);
+				}
+				Real sum = {};
+				for (int i = 0; i < n; ++i) {
+					y[i] = std::exp(y[i] - maxY);
+					sum += y[i];
+				}
+				auto const invSum = Real(1) / sum;
+				for (int i = 0; i < n; ++i) {
+					y[i] *= invSum;
+				}
+			},
+			true,
+		};
+	}
+
+	static std::vector<Loss> const & all() {
+		static std::vector<Loss> list = {
+			halfSquared(),
+			huber(),
+			softmaxCrossEntropy(),
+		};
+		return list;
+	}
+
+	static Loss get(std::string const & name) {
+		for (auto const & f : all()) {
+			if (f.name == name) return f;
+		}
+		throw Common::Exception() << "I couldn't find what you were looking for";
+	}
+};
+
 template<typename Real>
 struct Layer {
 	using Vector = NeuralNet::Vector<Real>;
@@ -248,6 +358,18 @@ struct Layer {
 	Vector xErr, netErr;	// back-propagation
 	Matrix dw;				// batch training accumulation
 
+	// set by ANN::setConv, otherwise the layer is dense
+	std::optional<ConvShape> conv;
+	Matrix cols;			// conv only: im2col of x, one row per output position
+	Vector colErr;			// conv only: back-propagation scratch
+
+	// set by ANN::setSparse / ANN::prune, then w and dw are empty and the weights live here
+	std::optional<SparseWeights<Real>> sparse;
+
+	Vector mulMask;			// per-col weight update multipliers, i.e. the dropout mask.  scratch, sized like a row of w
+
+	LayerKernels kernels;	// blocking / tiling for this layer's shape, defaults unless Autotune.h picked something
+
 	Activation activation;
 	ActivationDeriv activationDeriv;
 	// until I get function read/write working (efficiently) ...
@@ -276,39 +398,95 @@ public:
 		xErr(sizeIn),
 		netErr(sizeOut),
 		dw(sizeOut, sizeIn+1),
+		mulMask(sizeIn),
 		activation(Activation::get("tanh")),
 		activationDeriv(ActivationDeriv::get("tanhDeriv"))
 	{
 		// welp TODO gonna need a setter for that now
 		x.v[sizeIn] = useBias ? 1 : 0;
 	}
+
+	// default weight initialization ...
+	void randomizeWeights();
 };
 
 //TODO something from stl
 #include <stdlib.h>	//rand()
+
+// a thread can swap in its own seeded engine so its random() sequence is reproducible no matter what other threads do
+// i.e. one per sweep run.  unset = the shared rand()
+inline std::mt19937_64 *& threadRandomEngine() {
+	thread_local std::mt19937_64 * engine = {};
+	return engine;
+}
+
+// this thread's random() comes from 'engine' until this goes out of scope
+//	std::mt19937_64 engine(seed);
+//	NeuralNet::UseThreadRandom use(engine);
+struct UseThreadRandom {
+	std::mt19937_64 * prev = {};
+
+	UseThreadRandom(std::mt19937_64 & engine)
+	:	prev(threadRandomEngine())
+	{
+		threadRandomEngine() = &engine;
+	}
+	UseThreadRandom(UseThreadRandom const &) = delete;
+	~UseThreadRandom() {
+		threadRandomEngine() = prev;
+	}
+};
+
 template<typename Real = DefaultReal>
-Real random() { return (Real)rand() / (Real)RAND_MAX; }
+Real random() {
+	if (auto engine = threadRandomEngine()) {
+		// 53 bits in [0,1], same range as rand() / RAND_MAX
+		return (Real)((*engine)() >> 11) / (Real)((uint64_t(1) << 53) - 1);
+	}
+	return (Real)rand() / (Real)RAND_MAX;
+}
+
+template<typename Real>
+void Layer<Real>::randomizeWeights() {
+	for (int i = 0; i < w.height(); ++i) {
+		for (int j = 0; j < w.width(); ++j) {
+			w[i][j] = random<Real>() * 2 - 1;
+		}
+	}
+}
 
 
 
 // different kinds of multipliers to the weights upon update
 // One = normal
-// Dropout = filered-per-col (but that means traversing cols first then rows, opposite of memory order)
+// Dropout = filtered-per-col.  the kernels run row-major, so beginLayer() rolls each col once into a mask and f(j) reads it back
 // Dilution = randomly applies, so orig order is fine
+// f() = per-weight multiplier, f(j) = the multiplier for col j of the current layer
 
 template<typename Real>
 struct One {
 	static constexpr Real f() { return Real(1); }
+	static constexpr Real f(int) { return Real(1); }
+	static constexpr void beginLayer(Real *, int) {}
 };
 
 // same as Dilution, only a dif class for template specializing
 template<typename Real>
 struct Dropout {
 	Real dropout;
+	Real const * mask = {};
 	Dropout(Real dropout_) : dropout(dropout_) {}
 	Real f() const {
 		return random<Real>() < dropout ? Real(1) : Real(0);
 	}
+	Real f(int j) const { return mask[j]; }
+	// mask = scratch of at least 'width' Reals, i.e. Layer::mulMask
+	void beginLayer(Real * mask_, int width) {
+		for (int j = 0; j < width; ++j) {
+			mask_[j] = f();
+		}
+		mask = mask_;
+	}
 };
 
 template<typename Real>
@@ -318,132 +496,50 @@ struct Dilution {
 	Real f() const {
 		return random<Real>() < dilution ? Real(1) : Real(0);
 	}
+	Real f(int) const { return f(); }
+	static constexpr void beginLayer(Real *, int) {}
 };
 
-// by default do row major i.e. inner product mul
-template<typename Real, typename Mul>
-struct BackProp {
-	constexpr static void go(
-		Mul mul,
-		auto const height,
-		auto const width,
-		auto const storageHeight,
-		auto const storageWidth,
-		auto destwptr,
-		auto xptr,
-		auto neterrptr,
-		auto dt
-	) {
-		auto destwij = destwptr;
-		auto xendptr = xptr + storageWidth;
-		auto neterri = neterrptr;
-		auto neterriend = neterri + height;
-		for (; neterri < neterriend; ++neterri) {
-			auto const neterridt = dt * neterri[0];
-			for (auto xj = xptr; xj < xendptr;
-				xj += 8,
-				destwij += 8
-			) {
-				destwij[0] += neterridt * xj[0] * mul.f();
-				destwij[1] += neterridt * xj[1] * mul.f();
-				destwij[2] += neterridt * xj[2] * mul.f();
-				destwij[3] += neterridt * xj[3] * mul.f();
-				destwij[4] += neterridt * xj[4] * mul.f();
-				destwij[5] += neterridt * xj[5] * mul.f();
-				destwij[6] += neterridt * xj[6] * mul.f();
-				destwij[7] += neterridt * xj[7] * mul.f();
-			}
-		}
-	}
-};
+// feed-forward and back-propagation buffers for running many samples through an ANN at once
+// each matrix holds one sample per row, laid out the same as the matching Layer / ANN vector
+// kept outside of the ANN so several can share one set of weights
+template<typename Real = DefaultReal>
+struct Batch {
+	using Matrix = NeuralNet::Matrix<Real>;
 
-// for dropout, skip every randomly masked col, so we gotta reverse our mul loop order
-template<typename Real>
-struct BackProp<Real, Dropout<Real>> {
-	constexpr static void go(
-		Dropout<Real> mul,
-		auto const height,
-		auto const width,
-		auto const storageHeight,
-		auto const storageWidth,
-		auto destwptr,
-		auto xptr,
-		auto neterrptr,
-		auto dt
-	) {
-		for (int j = 0; j < width; ++j) {
-			if (mul.f()) {
-				Real const dt_xj = dt * xptr[j];
-				for (int i = 0; i < storageHeight; i += 8) {
-					destwptr[j + storageWidth * (i + 0)] += dt_xj * neterrptr[i + 0];
-					destwptr[j + storageWidth * (i + 1)] += dt_xj * neterrptr[i + 1];
-					destwptr[j + storageWidth * (i + 2)] += dt_xj * neterrptr[i + 2];
-					destwptr[j + storageWidth * (i + 3)] += dt_xj * neterrptr[i + 3];
-					destwptr[j + storageWidth * (i + 4)] += dt_xj * neterrptr[i + 4];
-					destwptr[j + storageWidth * (i + 5)] += dt_xj * neterrptr[i + 5];
-					destwptr[j + storageWidth * (i + 6)] += dt_xj * neterrptr[i + 6];
-					destwptr[j + storageWidth * (i + 7)] += dt_xj * neterrptr[i + 7];
-				}
-			}
-		}
-	}
-};
+	struct LayerBatch {
+		Matrix x, net;			// feed-forward
+		Matrix xErr, netErr;	// back-propagation
+		Matrix cols;			// conv layers only: im2col scratch, reused for each sample
+	};
 
-template<typename Real, typename Mul>
-struct UpdateBatch {
-	constexpr static void go(
-		Mul mul,
-		auto const height,
-		auto const width,
-		auto const storageHeight,
-		auto const storageWidth,
-		auto wptr,
-		auto dwptr
-	) {
-		auto wijptr = wptr;
-		auto dwijptr = dwptr;
-		auto wijendptr = wijptr + storageWidth * height;
-		for (; wijptr < wijendptr;
-			wijptr += 8,
-			dwijptr += 8
-		) {
-			wijptr[0] += dwijptr[0] * mul.f();
-			wijptr[1] += dwijptr[1] * mul.f();
-			wijptr[2] += dwijptr[2] * mul.f();
-			wijptr[3] += dwijptr[3] * mul.f();
-			wijptr[4] += dwijptr[4] * mul.f();
-			wijptr[5] += dwijptr[5] * mul.f();
-			wijptr[6] += dwijptr[6] * mul.f();
-			wijptr[7] += dwijptr[7] * mul.f();
-		}
-	}
-};
+	int size = {};
+	std::vector<LayerBatch> layers;
+	Matrix output, outputError, desired;
 
-template<typename Real>
-struct UpdateBatch<Real, Dropout<Real>> {
-	constexpr static void go(
-		Dropout<Real> mul,
-		auto const height,
-		auto const width,
-		auto const storageHeight,
-		auto const storageWidth,
-		auto wptr,
-		auto dwptr
-	) {
-		for (int j = 0; j < width; ++j) {
-			if (mul.f()) {
-				for (int i = 0; i < storageHeight; i += 8) {
-					wptr[j + storageWidth * (i + 0)] += dwptr[i + storageWidth * (i + 0)];
-					wptr[j + storageWidth * (i + 1)] += dwptr[i + storageWidth * (i + 1)];
-					wptr[j + storageWidth * (i + 2)] += dwptr[i + storageWidth * (i + 2)];
-					wptr[j + storageWidth * (i + 3)] += dwptr[i + storageWidth * (i + 3)];
-					wptr[j + storageWidth * (i + 4)] += dwptr[i + storageWidth * (i + 4)];
-					wptr[j + storageWidth * (i + 5)] += dwptr[i + storageWidth * (i + 5)];
-					wptr[j + storageWidth * (i + 6)] += dwptr[i + storageWidth * (i + 6)];
-					wptr[j + storageWidth * (i + 7)] += dwptr[i + storageWidth * (i + 7)];
-				}
+	Matrix & input() { return layers[0].x; }
+	Matrix & inputError() { return layers[0].xErr; }
+
+	Batch() {}
+
+	// layerSizes = input size followed by each layer's output size, same as the ANN ctor
+	Batch(int size_, std::vector<int> const & layerSizes)
+	:	size(size_)
+	{
+		for (size_t k = 0; k + 1 < layerSizes.size(); ++k) {
+			auto & layer = layers.emplace_back();
+			layer.x = Matrix(size, layerSizes[k]+1);
+			layer.xErr = Matrix(size, layerSizes[k]);
+			layer.net = Matrix(size, layerSizes[k+1]);
+			layer.netErr = Matrix(size, layerSizes[k+1]);
+			// same as Layer: bias input is always 1, the weight decides if it's used
+			for (int r = 0; r < size; ++r) {
+				layer.x[r][layerSizes[k]] = 1;
 			}
 		}
+		output = Matrix(size, layerSizes.back());
+		outputError = Matrix(size, layerSizes.back());
+		desired = Matrix(size, layerSizes.back());
 	}
 };
 
@@ -454,6 +550,8 @@ struct ANN {
 	using Layer = NeuralNet::Layer<Real>;
 	using Activation = NeuralNet::Activation<Real>;
 	using ActivationDeriv = NeuralNet::ActivationDeriv<Real>;
+	using Loss = NeuralNet::Loss<Real>;
+	using Batch = NeuralNet::Batch<Real>;
 
 	std::vector<Layer> layers;
 	// last-layer feed-forward components
@@ -464,7 +562,7 @@ struct ANN {
 	//timestep of the gradient to forward-Euler integrate along
 	Real dt = 1;
 
-	int useBatch = 0;	// set to a positive value to accumulate batch weight updates into the dw array
+	int useBatch = 0;	// set to a positive value to accumulate batch weight updates into the dw array.  QNNEnv's eligibility traces (useTraces) bypass it
 	int batchCounter = 0;
 
 	// what %age of the weight columns to update per-back-propagation / batch-update
@@ -473,6 +571,17 @@ struct ANN {
 	// what %age of the weights to update per-back-propagation / batch-update
 	Real dilution = 1;
 
+	// used by calcError
+	Loss loss = Loss::halfSquared();
+	void setLoss(std::string const & name) {
+		loss = Loss::get(name);
+		// the loss' gradient is already wrt the last layer's net, don't apply the activation twice
+		if (loss.fusedOutput) {
+			layers.back().setActivation("identity");
+			layers.back().setActivationDeriv("one");
+		}
+	}
+
 	//would be nice to just initialize a member-ref to layers[0].x
 	// but to od that, i'd need to initialize layers[] in the ctor member list
 	// and to do that I'd need t initialize layers[] alongside output, outputError, desired
@@ -488,14 +597,7 @@ struct ANN {
 		for (++layerSizeIter; layerSizeIter != layerSizes.end(); ++layerSizeIter) {
 			auto & layer = layers.emplace_back(prevLayerSize, *layerSizeIter);
 			prevLayerSize = *layerSizeIter;
-
-			// default weight initialization ...
-			for (int i = 0; i < layer.w.height(); ++i) {
-				for (int j = 0; j < layer.w.width(); ++j) {
-					layer.w[i][j] = random<Real>() * 2 - 1;
-				}
-			}
-
+			layer.randomizeWeights();
 		}
 		// final layer
 		output = Vector(prevLayerSize);
@@ -511,14 +613,7 @@ struct ANN {
 		for (++layerSizeIter; layerSizeIter != layerSizes.end(); ++layerSizeIter) {
 			auto & layer = layers.emplace_back(prevLayerSize, *layerSizeIter);
 			prevLayerSize = *layerSizeIter;
-
-			// default weight initialization ...
-			for (int i = 0; i < layer.w.height(); ++i) {
-				for (int j = 0; j < layer.w.width(); ++j) {
-					layer.w[i][j] = random<Real>() * 2 - 1;
-				}
-			}
-
+			layer.randomizeWeights();
 		}
 		// final layer
 		output = Vector(prevLayerSize);
@@ -528,11 +623,90 @@ struct ANN {
 
 
 
+	// turn layer k into a convolution
+	// the shape's input and output sizes have to match the layer's, so it still fits between its neighbors
+	void setConv(int k, ConvShape const & shape) {
+		shape.validate();
+		if (k < 0 || k >= (int)layers.size()) throw Common::Exception() << "layer " << k << " out of bounds";
+		auto & layer = layers[k];
+		if (shape.inSize() != layer.x.size) throw Common::Exception() << "convolution input size " << shape.inSize() << " doesn't match layer input size " << layer.x.size;
+		if (shape.outSize() != layer.net.size) throw Common::Exception() << "convolution output size " << shape.outSize() << " doesn't match layer output size " << layer.net.size;
+		layer.conv = shape;
+		layer.w = Matrix(shape.outChannels, shape.patchSize()+1);
+		layer.dw = Matrix(shape.outChannels, shape.patchSize()+1);
+		layer.cols = Matrix(shape.numPositions(), shape.patchSize()+1);
+		layer.colErr = Vector(shape.patchSize());
+		layer.mulMask = Vector(shape.patchSize());
+		layer.randomizeWeights();
+	}
+
+	// store layer k's weights sparse, keeping its nonzero weights (or for Block8, the 8-wide blocks with any)
+	// its dense w and dw are freed
+	void setSparse(int k, SparseFormat format) {
+		if (k < 0 || k >= (int)layers.size()) throw Common::Exception() << "layer " << k << " out of bounds";
+		auto & layer = layers[k];
+		if (layer.conv) throw Common::Exception() << "sparse weights not supported for conv layers";
+		if (layer.sparse) setDense(k);
+		layer.sparse = SparseWeights<Real>::fromDense(layer.w, format);
+		layer.w = Matrix();
+		layer.dw = Matrix();
+	}
+
+	// back to a dense w, with zeros where the pruned weights were
+	void setDense(int k) {
+		if (k < 0 || k >= (int)layers.size()) throw Common::Exception() << "layer " << k << " out of bounds";
+		auto & layer = layers[k];
+		if (!layer.sparse) return;
+		layer.w = Matrix(layer.sparse->height, layer.sparse->width);
+		layer.dw = Matrix(layer.sparse->height, layer.sparse->width);
+		layer.sparse->toDense(layer.w);
+		layer.sparse.reset();
+	}
+
+	// zero the smallest 'fraction' of layer k's weights (bias excluded) and store what's left sparse
+	// a layer that's already sparse gets pruned further, the fraction being of all its weights, so it can be done a little at a time between training
+	// returns the number of weights stored
+	int prune(int k, Real fraction, SparseFormat format = SparseFormat::CSR) {
+		if (k < 0 || k >= (int)layers.size()) throw Common::Exception() << "layer " << k << " out of bounds";
+		if (layers[k].conv) throw Common::Exception() << "prune not supported for conv layers";
+		setDense(k);
+		Sparse<Real>::prune(layers[k].w, fraction, format);
+		setSparse(k, format);
+		return layers[k].sparse->numStored();
+	}
+
+	// same for every dense layer
+	int prune(Real fraction, SparseFormat format = SparseFormat::CSR) {
+		int stored = {};
+		for (int k = 0; k < (int)layers.size(); ++k) {
+			if (layers[k].conv) continue;
+			stored += prune(k, fraction, format);
+		}
+		return stored;
+	}
+
 	void feedForward() {
+		feedForwardFrom(0);
+	}
+
+	// feed forward layers firstLayer.. onward, the ones before are assumed up to date
+	void feedForwardFrom(size_t firstLayer) {
 		auto const numLayers = layers.size();
-		for (size_t k = 0; k < numLayers; ++k) {
+		for (size_t k = firstLayer; k < numLayers; ++k) {
 			auto & layer = layers[k];
 
+			if (layer.conv) {
+				auto & y = k == numLayers-1 ? output : layers[k+1].x;
+				Conv<Real>::im2col(*layer.conv, layer.x.v.data(), layer.cols.v.data(), layer.cols.storageWidth());
+				Conv<Real>::forward(layer, layer.cols, layer.net.v.data(), y.v.data());
+				continue;
+			}
+			if (layer.sparse) {
+				layer.sparse->gemv(layer.x.v.data(), layer.net.v.data());
+				activate(k);
+				continue;
+			}
+
 			auto const & w = layer.w;
 			auto const height = w.size.x;
 			assert(w.size.y/*width*/ > 0);
@@ -554,87 +728,138 @@ struct ANN {
 
 			auto & y = k == numLayers-1 ? output : layers[k+1].x;
 			assert(y.storageSize == net.storageSize);
-			assert(y.storageSize == roundup<8>(w.size.x/*height*/));
+			assert(y.storageSize == roundup<8>(w.size.x/*height*/+1));	// Vector storage includes the bias slot
 
-			auto const & activation = layer.activation.f;
-			auto wij = w.v.data();
-			auto xptr = x.v.data();
-			auto const xendptr = xptr + storageWidth;
-			auto neti = net.v.data();	//net.v.begin() ? which is faster?
-			auto const netiend = neti + height;
-			auto yi = y.v.data();
-
-			for (; neti < netiend;
-				++neti, ++yi
-			) {
-				auto xj = xptr;
-				*neti = 0;
-				for (; xj < xendptr;
-					xj += 8, wij += 8
-				) {
-					neti[0] += wij[0] * xj[0]
-							+ wij[1] * xj[1]
-							+ wij[2] * xj[2]
-							+ wij[3] * xj[3]
-							+ wij[4] * xj[4]
-							+ wij[5] * xj[5]
-							+ wij[6] * xj[6]
-							+ wij[7] * xj[7]
-					;
-				}
-				*yi = activation(*neti);
+			Kernels<Real>::gemv(height, storageWidth, w.v.data(), x.v.data(), net.v.data(), layer.kernels.forward);
+			activate(k);
+		}
+		if (loss.outputTransform) loss.outputTransform(output.v.data(), output.size);
+	}
+
+	// y = activation(net) for dense layer k
+	void activate(size_t k) {
+		auto & layer = layers[k];
+		auto & y = k == layers.size()-1 ? output : layers[k+1].x;
+		auto const & activation = layer.activation.f;
+		auto neti = layer.net.v.data();
+		auto const netiend = neti + layer.net.size;
+		auto yi = y.v.data();
+		for (; neti < netiend; ++neti, ++yi) {
+			*yi = activation(*neti);
+		}
+	}
+
+	// feedForward for when only a few inputs changed since the last one
+	// input() already holds the new values, deltas[c] = new - old value of input()[indexes[c]]
+	// layer 0's net gets just those columns of w added to it, O(height * count) instead of O(height * width), then the rest of the layers run as usual
+	// layer 0's net has to be from a feedForward with the same weights, so after any weight update call feedForward() first
+	// rounding error adds up over consecutive calls, so every so often call feedForward() anyway
+	void feedForwardChanged(int const * indexes, Real const * deltas, int count) {
+		auto & layer = layers[0];
+		if (layer.conv) throw Common::Exception() << "feedForwardChanged not supported for conv layers";
+		if (layer.sparse) throw Common::Exception() << "feedForwardChanged not supported for sparse layers";
+		auto const height = layer.w.height();
+		auto const storageWidth = layer.w.storageWidth();
+		auto wi = layer.w.v.data();
+		auto neti = layer.net.v.data();
+		for (int i = 0; i < height; ++i, ++neti, wi += storageWidth) {
+			Real sum = *neti;
+			for (int c = 0; c < count; ++c) {
+				assert(indexes[c] >= 0 && indexes[c] < layer.x.size);
+				sum += wi[indexes[c]] * deltas[c];
 			}
-			assert(neti == net.v.data() + height);
-			assert(yi == y.v.data() + height);
-			assert(wij == w.v.data() + storageWidth * height);
+			*neti = sum;
 		}
+		activate(0);
+		feedForwardFrom(1);
 	}
 
 	Real calcError() {
 		assert(desired.size == outputError.size);
-		Real s = {};
-		for (int i = 0; i < outputError.size; ++i) {
-			auto delta = desired[i] - output[i];
-			outputError[i] = delta;
-			s += delta * delta;
+		return loss.f(output.v.data(), desired.v.data(), outputError.v.data(), outputError.size);
+	}
+
+	// netErr = yErr * activation'(net, y) for layer k
+	void calcNetErr(int k) {
+		int const numLayers = (int)layers.size();
+		auto & layer = layers[k];
+		auto & y = k == numLayers-1 ? output : layers[k+1].x;
+		auto & yErr = k == numLayers-1 ? outputError : layers[k+1].xErr;
+		auto const & activationDeriv = layer.activationDeriv.f;
+		auto const height = layer.net.size;
+		assert(height == y.size);
+		assert(height == layer.netErr.size);
+		auto neti = layer.net.v.data();
+		auto neterri = layer.netErr.v.data();
+		auto neterriend = neterri + height;
+		auto yerri = yErr.v.data();
+		auto yi = y.v.data();
+		for (; neterri < neterriend;
+			neterri += 8,
+			neti += 8,
+			yerri += 8,
+			yi += 8
+		) {
+			neterri[0] = yerri[0] * activationDeriv(neti[0], yi[0]);
+			neterri[1] = yerri[1] * activationDeriv(neti[1], yi[1]);
+			neterri[2] = yerri[2] * activationDeriv(neti[2], yi[2]);
+			neterri[3] = yerri[3] * activationDeriv(neti[3], yi[3]);
+			neterri[4] = yerri[4] * activationDeriv(neti[4], yi[4]);
+			neterri[5] = yerri[5] * activationDeriv(neti[5], yi[5]);
+			neterri[6] = yerri[6] * activationDeriv(neti[6], yi[6]);
+			neterri[7] = yerri[7] * activationDeriv(neti[7], yi[7]);
 		}
-		return Real(.5) * s;
 	}
 
-	template<typename Mul>
-	void backPropagateWithPerWeightMul(Real dt, Mul mul) {
+	// same but only rows[0..count), the rest of netErr is zeroed, for when the rest of yErr is zero
+	void calcNetErr(int k, int const * rows, int count) {
+		int const numLayers = (int)layers.size();
+		auto & layer = layers[k];
+		auto & y = k == numLayers-1 ? output : layers[k+1].x;
+		auto & yErr = k == numLayers-1 ? outputError : layers[k+1].xErr;
+		auto const & activationDeriv = layer.activationDeriv.f;
+		std::fill(layer.netErr.v.begin(), layer.netErr.v.begin() + layer.netErr.size, Real());
+		for (int r = 0; r < count; ++r) {
+			int const i = rows[r];
+			assert(i >= 0 && i < layer.netErr.size);
+			layer.netErr[i] = yErr[i] * activationDeriv(layer.net[i], y[i]);
+		}
+	}
+
+	// back-propagate outputError through every layer, last to first
+	// per layer this fills netErr and xErr (using the pre-update weights)
+	// then calls updateLayer(layer) to apply whatever weight update the caller wants
+	// if outputRows is given, outputError is zero except at outputRows[0..outputCount), and the last layer only visits those rows
+	template<typename UpdateLayer>
+	void backPropagateError(UpdateLayer && updateLayer, int const * outputRows = {}, int outputCount = 0) {
 		int const numLayers = (int)layers.size();
 		for (int k = (int)numLayers-1; k >= 0; --k) {
 			auto & layer = layers[k];
-			auto & y = k == numLayers-1 ? output : layers[k+1].x;
-			auto & yErr = k == numLayers-1 ? outputError : layers[k+1].xErr;
-			auto const & activationDeriv = layer.activationDeriv.f;
-			auto const height = layer.w.height();
-			assert(height == y.size);
-			assert(height == layer.netErr.size);
-			{
-				auto neti = layer.net.v.data();
-				auto neterri = layer.netErr.v.data();
-				auto neterriend = neterri + height;
-				auto yerri = yErr.v.data();
-				auto yi = y.v.data();
-				for (; neterri < neterriend;
-					neterri += 8,
-					neti += 8,
-					yerri += 8,
-					yi += 8
-				) {
-					neterri[0] = yerri[0] * activationDeriv(neti[0], yi[0]);
-					neterri[1] = yerri[1] * activationDeriv(neti[1], yi[1]);
-					neterri[2] = yerri[2] * activationDeriv(neti[2], yi[2]);
-					neterri[3] = yerri[3] * activationDeriv(neti[3], yi[3]);
-					neterri[4] = yerri[4] * activationDeriv(neti[4], yi[4]);
-					neterri[5] = yerri[5] * activationDeriv(neti[5], yi[5]);
-					neterri[6] = yerri[6] * activationDeriv(neti[6], yi[6]);
-					neterri[7] = yerri[7] * activationDeriv(neti[7], yi[7]);
+			auto const height = layer.net.size;
+			if (outputRows && k == numLayers-1 && !layer.conv && !layer.sparse) {
+				calcNetErr(k, outputRows, outputCount);
+				// xErr = the listed rows of w^T netErr
+				auto const xerr = layer.xErr.v.data();
+				auto const xErrSize = layer.xErr.size;
+				std::fill(xerr, xerr + xErrSize, Real());
+				for (int r = 0; r < outputCount; ++r) {
+					int const i = outputRows[r];
+					auto const neterr = layer.netErr[i];
+					auto const wi = layer.w.v.data() + layer.w.storageWidth() * i;
+					for (int j = 0; j < xErrSize; ++j) {
+						xerr[j] += wi[j] * neterr;
+					}
 				}
+				updateLayer(layer);
+				continue;
 			}
+			calcNetErr(k);
 			// back-propagate error
+			if (layer.conv) {
+				Conv<Real>::backPropagateError(layer, layer.netErr.v.data(), layer.xErr.v.data(), layer.colErr.v.data());
+			} else if (layer.sparse) {
+				layer.sparse->backwardError(layer.netErr.v.data(), layer.xErr.v.data(), layer.xErr.size);
+			} else
 #if 1
 			{
 				auto xerrj = layer.xErr.v.data();
@@ -679,21 +904,76 @@ struct ANN {
 			// adjust new weights
 			// not try necessarily, the weight will be zero, the input can be anything
 			//assert(layer.x[layer.x.size] == (layer.getBias() ? 1 : 0));
-			{
-				BackProp<Real, Mul>::go(
+			updateLayer(layer);
+		}
+	}
+
+	// same as backPropagateError + updating every layer, but dense layers do their xErr and weight update in one pass
+	// outputRows works the same as backPropagateError's, the last layer only computes and updates those rows
+	template<typename Mul>
+	void backPropagateWithPerWeightMul(Real dt, Mul mul, int const * outputRows = {}, int outputCount = 0) {
+		int const numLayers = (int)layers.size();
+		for (int k = numLayers-1; k >= 0; --k) {
+			auto & layer = layers[k];
+			bool const sparseOutput = outputRows && k == numLayers-1 && !layer.conv && !layer.sparse;
+			if (sparseOutput) {
+				calcNetErr(k, outputRows, outputCount);
+			} else {
+				calcNetErr(k);
+			}
+			if (layer.sparse) {
+				auto & sw = *layer.sparse;
+				mul.beginLayer(layer.mulMask.v.data(), sw.width);
+				sw.backward(mul, layer.x.v.data(), layer.netErr.v.data(), layer.xErr.v.data(), layer.xErr.size, useBatch ? sw.dvalues.data() : sw.values.data(), dt);
+				continue;
+			}
+			auto const destwptr = useBatch
+				? layer.dw.v.data() 	// ... accumulate into dw
+				: layer.w.v.data();		// ... directly/immediately
+			mul.beginLayer(layer.mulMask.v.data(), layer.w.width());
+			if (sparseOutput) {
+				Kernels<Real>::backwardSparse(
 					mul,
-					layer.w.height(),
-					layer.w.width(),
-					layer.w.storageHeight(),
+					outputRows,
+					outputCount,
 					layer.w.storageWidth(),
-					useBatch 				//destwptr
-						? layer.dw.v.data() 	// ... accumulate into dw
-						: layer.w.v.data(),		// ... directly/immediately
-					layer.x.v.data(),		//xptr
-					layer.netErr.v.data(),	//neterrptr
+					layer.w.v.data(),
+					destwptr,
+					layer.x.v.data(),
+					layer.netErr.v.data(),
+					layer.xErr.v.data(),
+					layer.xErr.size,
 					dt
 				);
+				continue;
 			}
+			if (layer.conv) {
+				Conv<Real>::backPropagateError(layer, layer.netErr.v.data(), layer.xErr.v.data(), layer.colErr.v.data());
+				Conv<Real>::template backPropagateWeights<Mul>(
+					mul,
+					layer,
+					layer.cols,
+					layer.netErr.v.data(),
+					destwptr,
+					dt
+				);
+				continue;
+			}
+			assert(layer.x.size == layer.xErr.size);
+			assert(layer.x.size == layer.w.width()-1);
+			Kernels<Real>::backward(
+				mul,
+				layer.w.height(),
+				layer.w.storageWidth(),
+				layer.w.v.data(),
+				destwptr,
+				layer.x.v.data(),
+				layer.netErr.v.data(),
+				layer.xErr.v.data(),
+				layer.xErr.size,
+				dt,
+				layer.kernels.backward
+			);
 		}
 
 		if (useBatch) {
@@ -704,36 +984,43 @@ struct ANN {
 			}
 		}
 	}
-	void backPropagate(Real dt) {
+	// outputError is zero except at outputRows[0..outputCount)
+	void backPropagate(Real dt, int const * outputRows, int outputCount) {
 		if (dropout == Real(1) && dilution == Real(1)) {
-			backPropagateWithPerWeightMul<One<Real>>(dt, One<Real>());
+			backPropagateWithPerWeightMul<One<Real>>(dt, One<Real>(), outputRows, outputCount);
 		} else if (dropout != Real(1)) {
-			backPropagateWithPerWeightMul<Dropout<Real>>(dt, Dropout<Real>(dropout));
+			backPropagateWithPerWeightMul<Dropout<Real>>(dt, Dropout<Real>(dropout), outputRows, outputCount);
 		} else {	// with dilution
-			backPropagateWithPerWeightMul<Dilution<Real>>(dt, Dilution<Real>(dilution));
+			backPropagateWithPerWeightMul<Dilution<Real>>(dt, Dilution<Real>(dilution), outputRows, outputCount);
 		}
 	}
+	void backPropagate(Real dt) {
+		backPropagate(dt, nullptr, 0);
+	}
 	void backPropagate() {
 		backPropagate(dt);
 	}
 
-	// update weights by batch ... and then clear the batch
+	// update weights by batch ... and clear the batch in the same pass
 	template<typename Mul>
 	void updateBatchWithPerWeightMul(Mul mul) {
 		if (!useBatch) return;
 		for (int k = (int)layers.size()-1; k >= 0; --k) {
 			auto & layer = layers[k];
-			UpdateBatch<Real, Mul>::go(
+			if (layer.sparse) {
+				mul.beginLayer(layer.mulMask.v.data(), layer.sparse->width);
+				layer.sparse->updateBatch(mul);
+				continue;
+			}
+			mul.beginLayer(layer.mulMask.v.data(), layer.w.width());
+			Kernels<Real>::updateBatch(
 				mul,
 				layer.w.height(),
-				layer.w.width(),
-				layer.w.storageHeight(),
 				layer.w.storageWidth(),
 				layer.w.v.data(),	//wptr
 				layer.dw.v.data()	//dwptr
 			);
 		}
-		clearBatch();
 	}
 	void updateBatch() {
 		if (dropout == Real(1) && dilution == Real(1)) {
@@ -750,7 +1037,364 @@ struct ANN {
 		for (int k = (int)layers.size()-1; k >= 0; --k) {
 			auto & layer = layers[k];
 			std::memset(layer.dw.v.data(), 0, sizeof(Real) * layer.dw.v.size());
+			if (layer.sparse) layer.sparse->clearBatch();
+		}
+	}
+
+	// copy only the weights of a same-shaped net, no reallocation
+	// sparse layers only avoid reallocating when they have the same pattern, i.e. weren't pruned since
+	void copyWeightsFrom(ANN const & src) {
+		assert(src.layers.size() == layers.size());
+		for (size_t k = 0; k < layers.size(); ++k) {
+			auto const & srcSparse = src.layers[k].sparse;
+			auto & dstSparse = layers[k].sparse;
+			if (srcSparse || dstSparse) {
+				if (srcSparse && dstSparse && srcSparse->index == dstSparse->index && srcSparse->rowStart == dstSparse->rowStart) {
+					std::copy(srcSparse->values.begin(), srcSparse->values.end(), dstSparse->values.begin());
+				} else {
+					dstSparse = srcSparse;
+					layers[k].w = src.layers[k].w;
+					layers[k].dw = src.layers[k].dw;
+				}
+				continue;
+			}
+			auto const & srcw = src.layers[k].w.v;
+			auto & dstw = layers[k].w.v;
+			assert(srcw.size() == dstw.size());
+			std::copy(srcw.begin(), srcw.end(), dstw.begin());
+		}
+	}
+
+	// batched versions:
+
+	std::vector<int> getLayerSizes() const {
+		std::vector<int> sizes;
+		sizes.push_back(layers[0].x.size);
+		for (auto const & layer : layers) {
+			sizes.push_back(layer.net.size);
+		}
+		return sizes;
+	}
+
+	Batch newBatch(int size) const {
+		Batch batch(size, getLayerSizes());
+		for (size_t k = 0; k < layers.size(); ++k) {
+			if (layers[k].conv) {
+				batch.layers[k].cols = Matrix(layers[k].cols.height(), layers[k].cols.width());
+			}
+		}
+		return batch;
+	}
+
+	// feed forward every row of batch.input() into batch.output
+	// each weight row is read once per batch instead of once per sample
+	void feedForward(Batch & batch) const {
+		auto const numLayers = layers.size();
+		assert(batch.layers.size() == numLayers);
+		for (size_t k = 0; k < numLayers; ++k) {
+			auto const & layer = layers[k];
+			auto & lb = batch.layers[k];
+			auto & y = k == numLayers-1 ? batch.output : batch.layers[k+1].x;
+
+			if (layer.conv) {
+				for (int r = 0; r < batch.size; ++r) {
+					Conv<Real>::im2col(*layer.conv, lb.x[r].v, lb.cols.v.data(), lb.cols.storageWidth());
+					Conv<Real>::forward(layer, lb.cols, lb.net[r].v, y[r].v);
+				}
+				continue;
+			}
+
+			auto const height = layer.net.size;
+			assert(lb.net.width() == height);
+			if (layer.sparse) {
+				for (int r = 0; r < batch.size; ++r) {
+					layer.sparse->gemv(lb.x[r].v, lb.net[r].v);
+				}
+			} else {
+				auto const & w = layer.w;
+				auto const storageWidth = w.storageWidth();
+				assert(lb.x.storageWidth() == storageWidth);
+
+				Kernels<Real>::gemm(
+					height,
+					storageWidth,
+					w.v.data(),
+					batch.size,
+					lb.x.v.data(),
+					lb.x.storageWidth(),
+					lb.net.v.data(),
+					1,
+					lb.net.storageWidth(),
+					layer.kernels.forwardBatch
+				);
+			}
+
+			auto const & activation = layer.activation.f;
+			for (int r = 0; r < batch.size; ++r) {
+				auto const netr = lb.net[r].v;
+				auto const yr = y[r].v;
+				for (int i = 0; i < height; ++i) {
+					yr[i] = activation(netr[i]);
+				}
+			}
+		}
+		if (loss.outputTransform) {
+			for (int r = 0; r < batch.size; ++r) {
+				loss.outputTransform(batch.output[r].v, batch.output.width());
+			}
+		}
+	}
+
+	Real calcError(Batch & batch) {
+		Real s = {};
+		for (int r = 0; r < batch.size; ++r) {
+			s += loss.f(batch.output[r].v, batch.desired[r].v, batch.outputError[r].v, batch.outputError.width());
+		}
+		return s;
+	}
+
+	// netErr = yErr * activation'(net, y) for layer k, every row
+	void calcNetErr(Batch & batch, int k) {
+		int const numLayers = (int)layers.size();
+		auto & layer = layers[k];
+		auto & lb = batch.layers[k];
+		auto & y = k == numLayers-1 ? batch.output : batch.layers[k+1].x;
+		auto & yErr = k == numLayers-1 ? batch.outputError : batch.layers[k+1].xErr;
+		auto const & activationDeriv = layer.activationDeriv.f;
+		auto const height = layer.net.size;
+		for (int r = 0; r < batch.size; ++r) {
+			auto neterri = lb.netErr[r].v;
+			auto neti = lb.net[r].v;
+			auto yerri = yErr[r].v;
+			auto yi = y[r].v;
+			for (int i = 0; i < height; ++i) {
+				neterri[i] = yerri[i] * activationDeriv(neti[i], yi[i]);
+			}
+		}
+	}
+
+	// back-propagate every row of batch.outputError, same as backPropagateError() but per-sample
+	// updateLayer(layer, layerBatch) gets called once per layer to apply the summed weight update
+	template<typename UpdateLayer>
+	void backPropagateError(Batch & batch, UpdateLayer && updateLayer) {
+		int const numLayers = (int)layers.size();
+		assert((int)batch.layers.size() == numLayers);
+		for (int k = numLayers-1; k >= 0; --k) {
+			auto & layer = layers[k];
+			auto & lb = batch.layers[k];
+			auto const height = layer.net.size;
+			auto const storageWidth = layer.w.storageWidth();
+			calcNetErr(batch, k);
+
+			if (layer.conv) {
+				for (int r = 0; r < batch.size; ++r) {
+					Conv<Real>::backPropagateError(layer, lb.netErr[r].v, lb.xErr[r].v, layer.colErr.v.data());
+				}
+				updateLayer(layer, lb);
+				continue;
+			}
+			if (layer.sparse) {
+				for (int r = 0; r < batch.size; ++r) {
+					layer.sparse->backwardError(lb.netErr[r].v, lb.xErr[r].v, layer.xErr.size);
+				}
+				updateLayer(layer, lb);
+				continue;
+			}
+
+			// xErr = netErr * w, row-major so each weight row is read once
+			std::fill(lb.xErr.v.begin(), lb.xErr.v.end(), Real());
+			auto const xErrSize = layer.xErr.size;
+			auto wi = layer.w.v.data();
+			for (int i = 0; i < height; ++i, wi += storageWidth) {
+				for (int r = 0; r < batch.size; ++r) {
+					auto const neterri = lb.netErr[r][i];
+					auto xerrj = lb.xErr[r].v;
+					for (int j = 0; j < xErrSize; ++j) {
+						xerrj[j] += wi[j] * neterri;
+					}
+				}
+			}
+
+			updateLayer(layer, lb);
+		}
+	}
+
+	// dense layers do the whole batch's xErr and weight update in one pass over the weights
+	template<typename Mul>
+	void backPropagateWithPerWeightMul(Batch & batch, Real dt, Mul mul) {
+		assert(batch.layers.size() == layers.size());
+		for (int k = (int)layers.size()-1; k >= 0; --k) {
+			auto & layer = layers[k];
+			auto & lb = batch.layers[k];
+			calcNetErr(batch, k);
+			if (layer.sparse) {
+				// xErr for every row first, the weight update below changes the weights
+				auto & sw = *layer.sparse;
+				mul.beginLayer(layer.mulMask.v.data(), sw.width);
+				for (int r = 0; r < batch.size; ++r) {
+					sw.backwardError(lb.netErr[r].v, lb.xErr[r].v, layer.xErr.size);
+				}
+				auto const dest = useBatch ? sw.dvalues.data() : sw.values.data();
+				for (int r = 0; r < batch.size; ++r) {
+					sw.update(mul, lb.x[r].v, lb.netErr[r].v, dest, dt);
+				}
+				continue;
+			}
+			auto const destwptr = useBatch ? layer.dw.v.data() : layer.w.v.data();
+			mul.beginLayer(layer.mulMask.v.data(), layer.w.width());
+			if (layer.conv) {
+				// xErr for every row first, the weight update below changes w
+				for (int r = 0; r < batch.size; ++r) {
+					Conv<Real>::backPropagateError(layer, lb.netErr[r].v, lb.xErr[r].v, layer.colErr.v.data());
+				}
+				for (int r = 0; r < batch.size; ++r) {
+					Conv<Real>::im2col(*layer.conv, lb.x[r].v, lb.cols.v.data(), lb.cols.storageWidth());
+					Conv<Real>::template backPropagateWeights<Mul>(
+						mul,
+						layer,
+						lb.cols,
+						lb.netErr[r].v,
+						destwptr,
+						dt
+					);
+				}
+				continue;
+			}
+			assert(lb.x.storageWidth() == layer.w.storageWidth());
+			Kernels<Real>::backwardBatch(
+				mul,
+				layer.w.height(),
+				layer.w.storageWidth(),
+				layer.w.v.data(),
+				destwptr,
+				batch.size,
+				lb.x.v.data(),
+				lb.x.storageWidth(),
+				lb.netErr.v.data(),
+				lb.netErr.storageWidth(),
+				lb.xErr.v.data(),
+				lb.xErr.storageWidth(),
+				layer.xErr.size,
+				dt,
+				layer.kernels.backward
+			);
+		}
+
+		if (useBatch) {
+			batchCounter += batch.size;
+			if (batchCounter >= useBatch) {
+				updateBatch();
+				batchCounter = 0;
+			}
+		}
+	}
+	void backPropagate(Batch & batch, Real dt) {
+		if (dropout == Real(1) && dilution == Real(1)) {
+			backPropagateWithPerWeightMul<One<Real>>(batch, dt, One<Real>());
+		} else if (dropout != Real(1)) {
+			backPropagateWithPerWeightMul<Dropout<Real>>(batch, dt, Dropout<Real>(dropout));
+		} else {
+			backPropagateWithPerWeightMul<Dilution<Real>>(batch, dt, Dilution<Real>(dilution));
+		}
+	}
+	void backPropagate(Batch & batch) {
+		backPropagate(batch, dt);
+	}
+
+	// whole-dataset training, one sample per row of 'inputs' and 'targets'
+	// samples are shuffled every epoch, with random() so a UseThreadRandom engine makes it reproducible, and run 'batchSize' at a time
+	// batchSize = 1 matches calling feedForward / calcError / backPropagate per sample
+	// returns the mean error of each epoch
+	std::vector<Real> trainBatch(
+		Matrix const & inputs,
+		Matrix const & targets,
+		int epochs,
+		int batchSize = 1
+	) {
+		int const numSamples = inputs.height();
+		if (targets.height() != numSamples) throw Common::Exception() << "got " << numSamples << " inputs but " << targets.height() << " targets";
+		if (inputs.width() != layers[0].x.size) throw Common::Exception() << "expected inputs of width " << layers[0].x.size << " but got " << inputs.width();
+		if (targets.width() != output.size) throw Common::Exception() << "expected targets of width " << output.size << " but got " << targets.width();
+		if (batchSize < 1) throw Common::Exception() << "batchSize must be positive";
+
+		std::vector<int> order(numSamples);
+		for (int i = 0; i < numSamples; ++i) order[i] = i;
+
+		auto batch = newBatch(batchSize);
+		std::vector<Real> epochErrors;
+		for (int epoch = 0; epoch < epochs; ++epoch) {
+			for (int i = numSamples-1; i > 0; --i) {
+				// random() is [0,1] inclusive
+				std::swap(order[i], order[std::min(i, (int)(random<double>() * (i+1)))]);
+			}
+			Real error = {};
+			for (int start = 0; start < numSamples; start += batchSize) {
+				// the batch matrices are allocated for batchSize rows, the last batch may use fewer
+				batch.size = std::min(batchSize, numSamples - start);
+				for (int r = 0; r < batch.size; ++r) {
+					auto const src = order[start + r];
+					std::copy(inputs[src].v, inputs[src].v + inputs.width(), batch.input()[r].v);
+					std::copy(targets[src].v, targets[src].v + targets.width(), batch.desired[r].v);
+				}
+				feedForward(batch);
+				error += calcError(batch);
+				backPropagate(batch);
+			}
+			epochErrors.push_back(numSamples ? error / (Real)numSamples : Real());
+		}
+		return epochErrors;
+	}
+
+	// modeled flops / bytes of layer k's phases for 'batchSize' samples, with the current dropout / dilution / useBatch
+	LayerCost layerCost(int k, int batchSize = 1) const {
+		if (k < 0 || k >= (int)layers.size()) throw Common::Exception() << "layer " << k << " out of range";
+		return CostModel<Real>::layer(layers[k], batchSize, dropout != Real(1), dilution != Real(1), useBatch != 0);
+	}
+
+	// summed over every layer
+	LayerCost cost(int batchSize = 1) const {
+		LayerCost c;
+		for (int k = 0; k < (int)layers.size(); ++k) {
+			c += layerCost(k, batchSize);
+		}
+		return c;
+	}
+
+	// smallest power-of-two batch whose modeled forward time per sample is within 5% of the best up to 'maxBatchSize'
+	// past that, bigger batches only cost memory
+	int forwardBatchSize(int numSamples, Roofline const & roof = {}, int maxBatchSize = 1024) const {
+		int const limit = std::max(1, std::min(numSamples, maxBatchSize));
+		auto const perSample = [&](int n) { return roof.time(cost(n).forward) / (double)n; };
+		double best = perSample(1);
+		for (int n = 2; n <= limit; n <<= 1) {
+			best = std::min(best, perSample(n));
+		}
+		best = std::min(best, perSample(limit));
+		for (int n = 1; n < limit; n <<= 1) {
+			if (perSample(n) <= best * 1.05) return n;
+		}
+		return limit;
+	}
+
+	// feed forward every row of 'inputs', returns the outputs one per row
+	// batchSize 0 = pick one with forwardBatchSize()
+	Matrix evaluate(Matrix const & inputs, int batchSize = 0) const {
+		int const numSamples = inputs.height();
+		if (inputs.width() != layers[0].x.size) throw Common::Exception() << "expected inputs of width " << layers[0].x.size << " but got " << inputs.width();
+		if (batchSize <= 0) batchSize = forwardBatchSize(numSamples);
+		Matrix outputs(numSamples, output.size);
+		auto batch = newBatch(batchSize);
+		for (int start = 0; start < numSamples; start += batchSize) {
+			batch.size = std::min(batchSize, numSamples - start);
+			for (int r = 0; r < batch.size; ++r) {
+				std::copy(inputs[start + r].v, inputs[start + r].v + inputs.width(), batch.input()[r].v);
+			}
+			feedForward(batch);
+			for (int r = 0; r < batch.size; ++r) {
+				std::copy(batch.output[r].v, batch.output[r].v + output.size, outputs[start + r].v);
+			}
 		}
+		return outputs;
 	}
 };
 
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "NeuralNet/ANN.h"
+#include "NeuralNet/MPSCQueue.h"
+#include "NeuralNet/PublishedWeights.h"
+#include "NeuralNet/Numa.h"
+
+/*
+QNNEnv split across threads:
+	actors: each steps its own env with its own copy of the weights, pulled from the learner every 'refreshInterval' steps
+	learner: pops every actor's transitions off one MPSC queue and does the backprop
+so env simulation and training overlap instead of adding up.
+
+Controller needs the same as QNNEnv, and its static functions must be safe to call from several threads.
+
+TD updates are one-step only, transitions from different actors arrive interleaved so there's no single trace to follow.
+
+multi-socket: setTopology() before start() pins the learner and each actor to a core, round-robin over NUMA nodes.
+each actor copies its weights from a thread already pinned, so they're first-touched on its own node,
+and with replicateWeights each node gets its own published copy to refresh from, kept in sync every publishInterval.
+*/
+template<typename Controller>
+struct ActorLearner {
+	using Real = typename Controller::Real;
+	using State = typename Controller::State;
+	using NN = decltype(Controller::createNeuralNet());
+
+	struct Transition {
+		State state;
+		int action = {};
+		Real reward = {};
+		State newState;
+		bool reset = {};
+	};
+
+	// the learner's weights
+	NN nn;
+
+	Real alpha = .1;
+	Real gamma = .99;
+	Real noise = 0;
+
+	int numActors = {};
+	int refreshInterval = 1000;	// actor steps between pulling the learner's weights
+	int publishInterval = 100;	// learner updates between publishing its weights
+
+	NeuralNet::MPSCQueue<Transition> queue;
+
+	std::atomic<int64_t> actorSteps = {};
+	std::atomic<int64_t> learnerUpdates = {};
+	std::atomic<double> rewardSum = {};
+
+	struct Stats {
+		double actorStepsPerSec = {};
+		double learnerUpdatesPerSec = {};
+		size_t queueDepth = {};
+		double avgReward = {};
+	};
+
+	ActorLearner(int numActors_, int queueCapacity = 1 << 16)
+	:	nn(Controller::createNeuralNet()),
+		numActors(numActors_),
+		queue(queueCapacity)
+	{
+		published.push_back(std::make_unique<NeuralNet::PublishedWeights<Real>>(nn));
+	}
+
+	~ActorLearner() {
+		stop();
+	}
+
+	// where to run, before start().  an empty topology = don't pin anything
+	// worker 0 is the learner, worker i+1 is actor i, see NumaTopology::cpuForWorker
+	void setTopology(NeuralNet::NumaTopology topology_, bool replicateWeights = true) {
+		if (!done) throw Common::Exception() << "can't change the topology while running";
+		topology = std::move(topology_);
+		if (!topology.empty()) {
+			// the learner's own weights and buffers, onto the learner's node
+			topology.runOnNode(topology.nodeForWorker(0), [&]() { nn = NN(nn); });
+		}
+		published.clear();
+		if (topology.empty() || !replicateWeights) {
+			published.push_back(std::make_unique<NeuralNet::PublishedWeights<Real>>(nn));
+		} else {
+			published.resize(topology.numNodes());
+			for (int node = 0; node < topology.numNodes(); ++node) {
+				topology.runOnNode(node, [&]() {
+					published[node] = std::make_unique<NeuralNet::PublishedWeights<Real>>(nn);
+				});
+			}
+		}
+	}
+
+	NeuralNet::NumaTopology const & getTopology() const { return topology; }
+
+	// picks the highest Q with some noise, same as QNNEnv::determineAction
+	static std::pair<int, Real> chooseAction(NN const & nn, Real noise) {
+		Real bestValue = nn.output[0];
+		if (noise) bestValue += noise * NeuralNet::random<Real>();
+		int bestAction = 0;
+		for (int i = 1; i < nn.output.size; ++i) {
+			Real checkValue = nn.output[i];
+			if (noise) checkValue += noise * NeuralNet::random<Real>();
+			if (bestValue < checkValue) {
+				bestValue = checkValue;
+				bestAction = i;
+			}
+		}
+		return std::make_pair(bestAction, nn.output[bestAction]);
+	}
+
+	// learner thread
+	void learn(Transition const & t) {
+		// maxNextQ = max(Q(S[t+1], *))
+		Controller::observe(t.newState, nn);
+		nn.feedForward();
+		Real maxNextQ = nn.output[0];
+		for (int i = 1; i < nn.output.size; ++i) {
+			maxNextQ = std::max(maxNextQ, nn.output[i]);
+		}
+
+		// Q(S[t], A[t]) with the learner's weights, not the stale ones the actor acted with
+		Controller::observe(t.state, nn);
+		nn.feedForward();
+		for (int i = 0; i < nn.output.size; ++i) {
+			nn.outputError[i] = 0;
+		}
+		// the TD error goes through nn.loss, i.e. Huber clips it
+		Real const target = t.reward + gamma * maxNextQ;
+		nn.loss.f(&nn.output[t.action], &target, &nn.outputError[t.action], 1);
+		nn.backPropagate(alpha);
+	}
+
+protected:
+	// actors pin the latest published weights to refresh their copy, so they never wait on the learner
+	// one per NUMA node when replicating, else just one
+	std::vector<std::unique_ptr<NeuralNet::PublishedWeights<Real>>> published;
+
+	NeuralNet::NumaTopology topology;
+
+	// which copy of the published weights actor 'actor' refreshes from
+	NeuralNet::PublishedWeights<Real> & publishedFor(int actor) {
+		if (published.size() == 1) return *published[0];
+		return *published[topology.nodeForWorker(actor + 1)];
+	}
+
+	std::atomic<bool> done = true;
+	std::vector<std::thread> actorThreads;
+	std::thread learnerThread;
+
+	std::chrono::steady_clock::time_point lastStatsTime = std::chrono::steady_clock::now();
+
+	void actorLoop(int actor) {
+		if (!topology.empty()) topology.pin(topology.cpuForWorker(actor + 1));
+		auto & published = publishedFor(actor);
+		// copied on this thread, so on this thread's node
+		NN local = [&]() {
+			auto pin = published.pin();
+			return NN(*pin);
+		}();
+		State state = Controller::initState();
+		int sinceRefresh = 0;
+		while (!done.load(std::memory_order_relaxed)) {
+			if (++sinceRefresh >= refreshInterval) {
+				auto pin = published.pin();
+				local.copyWeightsFrom(*pin);
+				sinceRefresh = 0;
+			}
+
+			Controller::observe(state, local);
+			local.feedForward();
+			auto [action, actionQ] = chooseAction(local, noise);
+
+			Transition t;
+			t.state = state;
+			t.action = action;
+			t.newState = Controller::performAction(state, action, actionQ);
+			std::tie(t.reward, t.reset) = Controller::getReward(t.newState);
+
+			// queue full = the learner is behind, wait for it
+			while (!queue.push(t)) {
+				if (done.load(std::memory_order_relaxed)) return;
+				std::this_thread::yield();
+			}
+			actorSteps.fetch_add(1, std::memory_order_relaxed);
+			rewardSum.fetch_add((double)t.reward, std::memory_order_relaxed);
+
+			state = t.reset ? Controller::initState() : t.newState;
+		}
+	}
+
+	void learnerLoop() {
+		if (!topology.empty()) topology.pin(topology.cpuForWorker(0));
+		Transition t;
+		int sincePublish = 0;
+		// replicas that missed the last publish because an actor had their spare pinned
+		std::vector<bool> stale(published.size());
+		while (!done.load(std::memory_order_relaxed)) {
+			if (!queue.pop(t)) {
+				std::this_thread::yield();
+				continue;
+			}
+			learn(t);
+			learnerUpdates.fetch_add(1, std::memory_order_relaxed);
+			// if an actor still has the spare pinned then try again next update
+			if (++sincePublish >= publishInterval) {
+				sincePublish = 0;
+				std::fill(stale.begin(), stale.end(), true);
+			}
+			for (size_t i = 0; i < published.size(); ++i) {
+				if (stale[i] && published[i]->publish(nn)) stale[i] = false;
+			}
+		}
+	}
+
+public:
+	void start() {
+		if (!done) return;
+		done = false;
+		learnerThread = std::thread([this]() { learnerLoop(); });
+		for (int i = 0; i < numActors; ++i) {
+			actorThreads.emplace_back([this, i]() { actorLoop(i); });
+		}
+	}
+
+	void stop() {
+		if (done) return;
+		done = true;
+		for (auto & thread : actorThreads) {
+			thread.join();
+		}
+		actorThreads.clear();
+		learnerThread.join();
+	}
+
+	// rates since the last call
+	Stats getStats() {
+		auto const now = std::chrono::steady_clock::now();
+		double const seconds = std::chrono::duration<double>(now - lastStatsTime).count();
+		lastStatsTime = now;
+
+		int64_t const steps = actorSteps.exchange(0);
+		int64_t const updates = learnerUpdates.exchange(0);
+		double const rewards = rewardSum.exchange(0);
+
+		Stats stats;
+		stats.actorStepsPerSec = seconds > 0 ? steps / seconds : 0;
+		stats.learnerUpdatesPerSec = seconds > 0 ? updates / seconds : 0;
+		stats.queueDepth = queue.size();
+		stats.avgReward = steps ? rewards / (double)steps : 0;
+		return stats;
+	}
+
+	// run for 'seconds', reporting every 'reportSeconds'
+	void run(double seconds, double reportSeconds = 1) {
+		start();
+		getStats();
+		auto const startTime = std::chrono::steady_clock::now();
+		while (std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() < seconds) {
+			std::this_thread::sleep_for(std::chrono::duration<double>(reportSeconds));
+			auto const stats = getStats();
+			std::cout << "actorSteps/sec=" << stats.actorStepsPerSec
+				<< " learnerUpdates/sec=" << stats.learnerUpdatesPerSec
+				<< " queueDepth=" << stats.queueDepth
+				<< " avgReward=" << stats.avgReward
+				<< std::endl;
+		}
+		stop();
+	}
+};
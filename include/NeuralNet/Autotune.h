@@ -0,0 +1,269 @@
+#pragma once
+
+#include "NeuralNet/ANN.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <cstdlib>
+#include <cstdio>
+
+namespace NeuralNet {
+
+/*
+times every KernelVariant of Kernels.h on each dense layer's shape and keeps the fastest in layer.kernels
+results are cached in a text file keyed by CPU model, Real size and shape, so the next run with the same shapes doesn't time anything
+
+	NeuralNet::autotune(nn);	// after constructing / resizing, before training
+
+convolution layers keep the defaults.
+*/
+template<typename Real = DefaultReal>
+struct Autotune {
+	using ANN = NeuralNet::ANN<Real>;
+	using Layer = NeuralNet::Layer<Real>;
+	using Clock = std::chrono::steady_clock;
+
+	std::string cachePath;
+	int batchSize = 32;					// number of samples forwardBatch is tuned for
+	double secondsPerVariant = .002;	// per timing, best of 3
+	bool verbose = false;
+
+	Autotune(std::string cachePath_ = defaultCachePath())
+	:	cachePath(cachePath_),
+		cpu(cpuModel())
+	{
+		load();
+	}
+
+	// "model name" from /proc/cpuinfo
+	static std::string cpuModel() {
+		std::ifstream f("/proc/cpuinfo");
+		std::string line;
+		while (std::getline(f, line)) {
+			if (line.rfind("model name", 0) == 0) {
+				auto colon = line.find(':');
+				if (colon != std::string::npos) {
+					auto start = line.find_first_not_of(" \t", colon + 1);
+					if (start != std::string::npos) return line.substr(start);
+				}
+			}
+		}
+		return "unknown";
+	}
+
+	// $NEURALNET_AUTOTUNE_CACHE, else under $XDG_CACHE_HOME or ~/.cache
+	static std::string defaultCachePath() {
+		if (auto path = std::getenv("NEURALNET_AUTOTUNE_CACHE")) return path;
+		std::string const name = "NeuralNet-autotune.txt";
+		if (auto dir = std::getenv("XDG_CACHE_HOME")) return std::string(dir) + "/" + name;
+		if (auto home = std::getenv("HOME")) return std::string(home) + "/.cache/" + name;
+		return name;
+	}
+
+	// returns the number of kernels that had to be timed, 0 = everything came from the cache
+	int tune(ANN & nn) {
+		int timed = 0;
+		for (auto & layer : nn.layers) {
+			if (layer.conv || layer.sparse) continue;
+			auto const height = layer.w.height();
+			auto const storageWidth = layer.w.storageWidth();
+			timed += pick(layer.kernels.forward, "forward", height, storageWidth, 1, [&]() {
+				return timeForward(layer);
+			});
+			timed += pick(layer.kernels.forwardBatch, "forwardBatch", height, storageWidth, batchSize, [&]() {
+				return timeForwardBatch(layer);
+			});
+			timed += pick(layer.kernels.backward, "backward", height, storageWidth, 1, [&]() {
+				return timeBackward(layer);
+			});
+		}
+		if (timed) save();
+		return timed;
+	}
+
+protected:
+	std::string cpu;
+	std::map<std::string, KernelVariant> cache;
+
+	std::string key(char const * kernel, int height, int storageWidth, int numSamples) const {
+		std::ostringstream ss;
+		ss << cpu << "|" << sizeof(Real) << "|" << kernel << "|" << height << "x" << storageWidth << "x" << numSamples;
+		return ss.str();
+	}
+
+	// one line per entry: key, tab, rowBlock sampleBlock tileWidth
+	void load() {
+		std::ifstream f(cachePath);
+		std::string line;
+		while (std::getline(f, line)) {
+			auto tab = line.rfind('\t');
+			if (tab == std::string::npos) continue;
+			KernelVariant v;
+			std::istringstream ss(line.substr(tab + 1));
+			if (ss >> v.rowBlock >> v.sampleBlock >> v.tileWidth) {
+				cache[line.substr(0, tab)] = v;
+			}
+		}
+	}
+
+	// write a temp file and rename it over, so a concurrent run never reads half a file
+	void save() {
+		auto const path = std::filesystem::path(cachePath);
+		std::error_code ec;
+		if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), ec);
+		auto const tmpPath = cachePath + ".tmp";
+		{
+			std::ofstream f(tmpPath);
+			if (!f) {
+				if (verbose) std::cerr << "autotune: couldn't write " << tmpPath << std::endl;
+				return;
+			}
+			for (auto const & [k, v] : cache) {
+				f << k << "\t" << v.rowBlock << " " << v.sampleBlock << " " << v.tileWidth << "\n";
+			}
+		}
+		std::rename(tmpPath.c_str(), cachePath.c_str());
+	}
+
+	// every variant worth timing for this shape
+	std::vector<KernelVariant> candidates(int storageWidth, int numSamples) const {
+		std::vector<KernelVariant> variants;
+		std::vector<int> tileWidths = {Kernels<Real>::tileWidth};
+		if (storageWidth > Kernels<Real>::tileWidth) tileWidths.push_back(storageWidth);	// untiled
+		std::vector<int> sampleBlocks = {1};
+		if (numSamples > 1) sampleBlocks = {1, 2, 4};
+		for (int rowBlock : {1, 2, 4}) {
+			for (int sampleBlock : sampleBlocks) {
+				for (int tileWidth : tileWidths) {
+					variants.push_back({rowBlock, sampleBlock, tileWidth});
+				}
+			}
+		}
+		return variants;
+	}
+
+	// time(variant) returns seconds per call
+	template<typename Time>
+	int pick(KernelVariant & dst, char const * kernel, int height, int storageWidth, int numSamples, Time && timeFor) {
+		auto const k = key(kernel, height, storageWidth, numSamples);
+		auto found = cache.find(k);
+		if (found != cache.end()) {
+			dst = found->second;
+			return 0;
+		}
+		auto time = timeFor();
+		KernelVariant best;
+		double bestTime = {};
+		for (auto const & variant : candidates(storageWidth, numSamples)) {
+			double const t = time(variant);
+			if (verbose) {
+				std::cout << "autotune " << kernel << " " << height << "x" << storageWidth << "x" << numSamples
+					<< " rowBlock=" << variant.rowBlock
+					<< " sampleBlock=" << variant.sampleBlock
+					<< " tileWidth=" << variant.tileWidth
+					<< " " << t * 1e6 << "us" << std::endl;
+			}
+			if (bestTime == 0 || t < bestTime) {
+				bestTime = t;
+				best = variant;
+			}
+		}
+		dst = best;
+		cache[k] = best;
+		return 1;
+	}
+
+	// best of 3, each repeating f for at least secondsPerVariant
+	template<typename F>
+	double measure(F && f) const {
+		f();	// warm up
+		double best = {};
+		for (int trial = 0; trial < 3; ++trial) {
+			int n = 0;
+			auto const start = Clock::now();
+			double elapsed = {};
+			do {
+				f();
+				++n;
+				elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			} while (elapsed < secondsPerVariant);
+			double const t = elapsed / (double)n;
+			if (trial == 0 || t < best) best = t;
+		}
+		return best;
+	}
+
+	static void fillRandom(std::vector<Real> & v, int rows, int stride, int width) {
+		for (int r = 0; r < rows; ++r) {
+			for (int j = 0; j < width; ++j) {
+				v[j + stride * r] = random<Real>() * 2 - 1;
+			}
+		}
+	}
+
+	// each of these sets up scratch buffers the shape of the layer and returns a function timing one variant
+	// the layer's own weights are only read
+
+	auto timeForward(Layer const & layer) const {
+		auto const height = layer.w.height();
+		auto const storageWidth = layer.w.storageWidth();
+		return [this, &layer, height, storageWidth,
+			x = std::vector<Real>(layer.x.v),
+			y = std::vector<Real>(layer.net.v.size())
+		](KernelVariant const & variant) mutable {
+			return measure([&]() {
+				Kernels<Real>::gemv(height, storageWidth, layer.w.v.data(), x.data(), y.data(), variant);
+			});
+		};
+	}
+
+	auto timeForwardBatch(Layer const & layer) const {
+		auto const height = layer.w.height();
+		auto const storageWidth = layer.w.storageWidth();
+		auto const yStride = (height + 8) & -8;
+		std::vector<Real> x(storageWidth * batchSize);
+		fillRandom(x, batchSize, storageWidth, layer.w.width());
+		return [this, &layer, height, storageWidth, yStride,
+			x = std::move(x),
+			y = std::vector<Real>(yStride * batchSize),
+			numSamples = batchSize
+		](KernelVariant const & variant) mutable {
+			return measure([&]() {
+				Kernels<Real>::gemm(height, storageWidth, layer.w.v.data(), numSamples, x.data(), storageWidth, y.data(), 1, yStride, variant);
+			});
+		};
+	}
+
+	auto timeBackward(Layer const & layer) const {
+		auto const height = layer.w.height();
+		auto const storageWidth = layer.w.storageWidth();
+		std::vector<Real> netErr(layer.netErr.v.size());
+		fillRandom(netErr, 1, 0, height);
+		std::vector<Real> x(storageWidth);
+		fillRandom(x, 1, 0, layer.w.width());
+		// updates a copy of the weights, with dt small enough not to drift over many calls
+		return [this, &layer, height, storageWidth,
+			w = std::vector<Real>(layer.w.v),
+			x = std::move(x),
+			netErr = std::move(netErr),
+			xErr = std::vector<Real>(storageWidth)
+		](KernelVariant const & variant) mutable {
+			return measure([&]() {
+				Kernels<Real>::backward(One<Real>(), height, storageWidth, w.data(), w.data(), x.data(), netErr.data(), xErr.data(), layer.x.size, Real(1e-6), variant);
+			});
+		};
+	}
+};
+
+// returns the number of kernels that had to be timed, 0 = everything came from the cache
+template<typename Real>
+int autotune(ANN<Real> & nn, std::string const & cachePath = Autotune<Real>::defaultCachePath()) {
+	return Autotune<Real>(cachePath).tune(nn);
+}
+
+}
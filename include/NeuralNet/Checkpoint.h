@@ -0,0 +1,377 @@
+#pragma once
+
+#include "NeuralNet/ANN.h"
+#include "Common/Exception.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace NeuralNet {
+
+/*
+periodic checkpoints of an ANN without stalling the trainer
+
+save() copies the weights, dw, sparse weights, batchCounter and the training settings into a snapshot buffer, one memcpy per array,
+then a background thread writes it to a temp file, fsyncs it, renames it over <dir>/<prefix>-<number>.ckpt and fsyncs the dir,
+so a crash leaves either the old checkpoint or the new one, never half of one.
+only the newest 'keep' checkpoints are kept.
+
+	NeuralNet::Checkpoint<float> checkpoint("checkpoints");
+	for (...) {
+		... train ...
+		if (step % 10000 == 0) checkpoint.save(nn);
+	}
+	...
+	NeuralNet::Checkpoint<float>::load(nn, NeuralNet::Checkpoint<float>::latest("checkpoints"));
+
+two snapshot buffers: the trainer fills one while the writer writes the other, and both are reused, so after the first save nothing allocates.
+if the writer still has the last one when the next save() comes then save() skips it and returns false rather than wait.
+
+activations, loss, conv shapes and kernels aren't saved: load() into a net constructed the same way.  layers come back sparse or dense as they were saved.
+the file is raw Reals, so it only loads on a machine with the same Real and endianness.
+*/
+template<typename Real = DefaultReal>
+struct Checkpoint {
+	using ANN = NeuralNet::ANN<Real>;
+
+	std::string dir;
+	std::string prefix = "checkpoint";
+	int keep = 3;	// how many checkpoint files to keep, oldest are deleted first
+
+	Checkpoint(std::string dir_, std::string prefix_ = "checkpoint", int keep_ = 3)
+	:	dir(dir_),
+		prefix(prefix_),
+		keep(keep_)
+	{
+		std::filesystem::create_directories(dir);
+		// carry on numbering after whatever is already there, and count those toward 'keep'
+		for (auto const & path : list(dir, prefix)) {
+			written.push_back(path);
+			nextNumber = std::max(nextNumber, number(path, prefix) + 1);
+		}
+		writer = std::thread([this]() { writeLoop(); });
+	}
+
+	Checkpoint(Checkpoint const &) = delete;
+	Checkpoint & operator=(Checkpoint const &) = delete;
+
+	~Checkpoint() {
+		{
+			std::lock_guard lock(mutex);
+			done = true;
+		}
+		cv.notify_all();
+		writer.join();
+	}
+
+	// trainer thread
+	// snapshot nn and queue it to be written.  false = the last one is still being written, nothing was saved
+	bool save(ANN const & nn) {
+		{
+			std::lock_guard lock(mutex);
+			if (pending) return false;
+		}
+		// the writer only touches buffers[writing] while pending, so this one is ours
+		auto & buffer = buffers[!writing];
+		snapshot(buffer, nn);
+		{
+			std::lock_guard lock(mutex);
+			writing = !writing;
+			pending = true;
+		}
+		cv.notify_all();
+		return true;
+	}
+
+	// blocks until the last save() is on disk
+	void flush() {
+		std::unique_lock lock(mutex);
+		cv.wait(lock, [this]() { return !pending; });
+	}
+
+	// the last write's error, empty if it worked
+	std::string lastError() const {
+		std::lock_guard lock(mutex);
+		return error;
+	}
+
+	// the retained checkpoints, oldest first
+	std::vector<std::string> files() const {
+		std::lock_guard lock(mutex);
+		return std::vector<std::string>(written.begin(), written.end());
+	}
+
+	// the newest checkpoint in 'dir', empty if there are none
+	static std::string latest(std::string const & dir, std::string const & prefix = "checkpoint") {
+		auto const paths = list(dir, prefix);
+		return paths.empty() ? std::string() : paths.back();
+	}
+
+	// restore what save() saved into a net with the same layer sizes
+	static void load(ANN & nn, std::string const & path) {
+		std::vector<char> buffer;
+		{
+			FILE * f = fopen(path.c_str(), "rb");
+			if (!f) throw Common::Exception() << "failed to open " << path;
+			fseek(f, 0, SEEK_END);
+			buffer.resize(ftell(f));
+			fseek(f, 0, SEEK_SET);
+			auto const n = fread(buffer.data(), 1, buffer.size(), f);
+			fclose(f);
+			if (n != buffer.size()) throw Common::Exception() << "failed to read " << path;
+		}
+		Reader r{buffer, 0, path};
+		if (r.template get<uint32_t>() != magic) throw Common::Exception() << path << " isn't a checkpoint";
+		if (r.template get<uint32_t>() != version) throw Common::Exception() << path << " is from a different checkpoint version";
+		if (r.template get<uint32_t>() != sizeof(Real)) throw Common::Exception() << path << " was saved with a different Real";
+		auto const layerSizes = r.template getVector<int32_t>();
+		auto const expected = nn.getLayerSizes();
+		if (!std::equal(layerSizes.begin(), layerSizes.end(), expected.begin(), expected.end())) {
+			throw Common::Exception() << path << " has different layer sizes";
+		}
+		nn.dt = r.template get<Real>();
+		nn.dropout = r.template get<Real>();
+		nn.dilution = r.template get<Real>();
+		nn.useBatch = r.template get<int32_t>();
+		nn.batchCounter = r.template get<int32_t>();
+		for (size_t k = 0; k < nn.layers.size(); ++k) {
+			auto & layer = nn.layers[k];
+			if (r.template get<int32_t>()) {
+				SparseWeights<Real> s;
+				s.format = (SparseFormat)r.template get<int32_t>();
+				s.height = r.template get<int32_t>();
+				s.width = r.template get<int32_t>();
+				s.storageWidth = r.template get<int32_t>();
+				s.rowStart = r.template getVector<int>();
+				s.index = r.template getVector<int>();
+				s.values = r.template getVector<Real>();
+				s.dvalues = r.template getVector<Real>();
+				layer.sparse = std::move(s);
+				layer.w = {};
+				layer.dw = {};
+			} else {
+				if (layer.sparse) nn.setDense((int)k);
+				r.getInto(layer.w.v, k);
+				r.getInto(layer.dw.v, k);
+			}
+		}
+	}
+
+protected:
+	static constexpr uint32_t magic = 0x4b434e4e;	// "NNCK"
+	static constexpr uint32_t version = 1;
+
+	// file layout, everything native-endian:
+	//	magic, version, sizeof(Real), layer sizes,
+	//	dt, dropout, dilution, useBatch, batchCounter,
+	//	per layer: isSparse, then w and dw storage (padding included), or the SparseWeights fields
+	// vectors are a uint64 count then their elements
+	static void snapshot(std::vector<char> & buffer, ANN const & nn) {
+		buffer.clear();
+		put(buffer, magic);
+		put(buffer, version);
+		put(buffer, (uint32_t)sizeof(Real));
+		auto const layerSizes = nn.getLayerSizes();
+		putVector(buffer, std::vector<int32_t>(layerSizes.begin(), layerSizes.end()));
+		put(buffer, nn.dt);
+		put(buffer, nn.dropout);
+		put(buffer, nn.dilution);
+		put(buffer, (int32_t)nn.useBatch);
+		put(buffer, (int32_t)nn.batchCounter);
+		for (auto const & layer : nn.layers) {
+			put(buffer, (int32_t)(bool)layer.sparse);
+			if (layer.sparse) {
+				auto const & s = *layer.sparse;
+				put(buffer, (int32_t)s.format);
+				put(buffer, (int32_t)s.height);
+				put(buffer, (int32_t)s.width);
+				put(buffer, (int32_t)s.storageWidth);
+				putVector(buffer, s.rowStart);
+				putVector(buffer, s.index);
+				putVector(buffer, s.values);
+				putVector(buffer, s.dvalues);
+			} else {
+				putVector(buffer, layer.w.v);
+				putVector(buffer, layer.dw.v);
+			}
+		}
+	}
+
+	static void putBytes(std::vector<char> & buffer, void const * src, size_t n) {
+		auto const offset = buffer.size();
+		buffer.resize(offset + n);
+		if (n) std::memcpy(buffer.data() + offset, src, n);
+	}
+
+	template<typename T>
+	static void put(std::vector<char> & buffer, T const & x) {
+		putBytes(buffer, &x, sizeof(T));
+	}
+
+	template<typename T>
+	static void putVector(std::vector<char> & buffer, T const & v) {
+		put(buffer, (uint64_t)v.size());
+		putBytes(buffer, v.data(), sizeof(v[0]) * v.size());
+	}
+
+	struct Reader {
+		std::vector<char> const & buffer;
+		size_t offset = {};
+		std::string const & path;
+
+		void getBytes(void * dst, size_t n) {
+			if (n > buffer.size() - offset) throw Common::Exception() << path << " is truncated";
+			if (n) std::memcpy(dst, buffer.data() + offset, n);
+			offset += n;
+		}
+
+		template<typename T>
+		T get() {
+			T x;
+			getBytes(&x, sizeof(T));
+			return x;
+		}
+
+		template<typename T>
+		std::vector<T> getVector() {
+			auto const n = get<uint64_t>();
+			if (n > (buffer.size() - offset) / sizeof(T)) throw Common::Exception() << path << " is truncated";
+			std::vector<T> v(n);
+			getBytes(v.data(), sizeof(T) * n);
+			return v;
+		}
+
+		// into an already-allocated array, which has to be the same size
+		void getInto(std::vector<Real> & v, size_t k) {
+			auto const n = get<uint64_t>();
+			if (n != v.size()) throw Common::Exception() << path << " has layer " << k << " a different size";
+			getBytes(v.data(), sizeof(Real) * n);
+		}
+	};
+
+	// <dir>/<prefix>-<number>.ckpt, oldest first
+	static std::vector<std::string> list(std::string const & dir, std::string const & prefix) {
+		std::vector<std::pair<long, std::string>> found;
+		std::error_code ec;
+		for (auto const & entry : std::filesystem::directory_iterator(dir, ec)) {
+			auto const path = entry.path().string();
+			auto const n = number(path, prefix);
+			if (n >= 0) found.emplace_back(n, path);
+		}
+		std::sort(found.begin(), found.end());
+		std::vector<std::string> paths;
+		for (auto const & [n, path] : found) paths.push_back(path);
+		return paths;
+	}
+
+	// -1 if it isn't one of ours
+	static long number(std::string const & path, std::string const & prefix) {
+		auto const name = std::filesystem::path(path).filename().string();
+		std::string const ext = ".ckpt";
+		if (name.size() <= prefix.size() + 1 + ext.size()
+			|| name.compare(0, prefix.size() + 1, prefix + "-") != 0
+			|| name.compare(name.size() - ext.size(), ext.size(), ext) != 0
+		) return -1;
+		auto const digits = name.substr(prefix.size() + 1, name.size() - prefix.size() - 1 - ext.size());
+		if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) return -1;
+		return std::stol(digits);
+	}
+
+	// writer thread:
+
+	void writeLoop() {
+		std::unique_lock lock(mutex);
+		for (;;) {
+			cv.wait(lock, [this]() { return pending || done; });
+			if (!pending) return;	// done, with nothing left to write
+			auto const & buffer = buffers[writing];
+			char name[32];
+			snprintf(name, sizeof(name), "-%08ld.ckpt", nextNumber++);
+			auto const path = dir + "/" + prefix + name;
+			lock.unlock();
+
+			auto const result = writeFile(path, buffer);
+
+			lock.lock();
+			error = result;
+			std::vector<std::string> expired;
+			if (result.empty()) {
+				written.push_back(path);
+				while (keep > 0 && (int)written.size() > keep) {
+					expired.push_back(written.front());
+					written.pop_front();
+				}
+			}
+			pending = false;
+			cv.notify_all();
+			// deleting can take a while too, don't hold up save() for it
+			lock.unlock();
+			for (auto const & old : expired) std::remove(old.c_str());
+			lock.lock();
+		}
+	}
+
+	// write, fsync, rename over, fsync the dir.  returns the error, empty if it worked
+	std::string writeFile(std::string const & path, std::vector<char> const & buffer) const {
+		auto const tmpPath = path + ".tmp";
+		int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) return "failed to open " + tmpPath + ": " + std::strerror(errno);
+		size_t offset = 0;
+		while (offset < buffer.size()) {
+			auto const n = ::write(fd, buffer.data() + offset, buffer.size() - offset);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				std::string const e = "failed to write " + tmpPath + ": " + std::strerror(errno);
+				::close(fd);
+				std::remove(tmpPath.c_str());
+				return e;
+			}
+			offset += n;
+		}
+		if (::fsync(fd) != 0) {
+			std::string const e = "failed to fsync " + tmpPath + ": " + std::strerror(errno);
+			::close(fd);
+			std::remove(tmpPath.c_str());
+			return e;
+		}
+		::close(fd);
+		if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+			std::string const e = "failed to rename " + tmpPath + ": " + std::strerror(errno);
+			std::remove(tmpPath.c_str());
+			return e;
+		}
+		// so the rename itself survives a crash
+		int dirfd = ::open(dir.c_str(), O_RDONLY);
+		if (dirfd >= 0) {
+			::fsync(dirfd);
+			::close(dirfd);
+		}
+		return {};
+	}
+
+	std::vector<char> buffers[2];
+	int writing = 0;		// which buffer the writer has, or had last
+	bool pending = false;	// buffers[writing] is waiting to be or being written
+	bool done = false;
+
+	long nextNumber = 0;
+	std::deque<std::string> written;
+	std::string error;
+
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+	std::thread writer;		// last, so everything it reads is constructed before it starts
+};
+
+}
@@ -0,0 +1,225 @@
+#pragma once
+/*
+freezes a trained ANN into a standalone header: its weights as constexpr arrays and its forward pass with every size a constant
+the generated code only includes <cmath>, and only when an activation needs it.  no heap, no std::function, no Tensor / Common.
+
+	NeuralNet::Codegen<double> codegen;
+	codegen.name = "PoleBalancer";
+	codegen.write("PoleBalancer.h", nn);
+
+then, in something that doesn't link NeuralNet at all:
+
+	#include "PoleBalancer.h"
+	PoleBalancer::Real y[PoleBalancer::outputSize];
+	PoleBalancer::forward(x, y);	// x = inputSize Reals
+
+weights are stored like Layer::w: one row per output, the bias last, rows padded to 8 and 64-byte aligned.
+layers with up to 'unrollLimit' weights get one unrolled expression per output, leaving out the zero weights, i.e. of pruned layers.
+bigger ones get a loop over the padded row in 8 independent sums, same as Kernels.h, which the compiler vectorizes.
+forward() is constexpr when no activation needs <cmath>.
+sums are in a different order than feedForward()'s, so outputs match it to rounding, not bit for bit.
+*/
+#include "NeuralNet/ANN.h"
+#include "Common/Exception.h"
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <vector>
+#include <cmath>
+
+namespace NeuralNet {
+
+template<typename Real>
+struct Codegen {
+	using ANN = NeuralNet::ANN<Real>;
+	using Matrix = NeuralNet::Matrix<Real>;
+
+	std::string name = "GeneratedNet";	// the namespace everything goes in
+	int unrollLimit = 4096;				// unroll layers with at most this many weights
+
+	void write(std::string const & path, ANN const & nn) const {
+		std::ofstream f(path);
+		if (!f) throw Common::Exception() << "failed to open " << path;
+		f << generate(nn);
+		if (!f) throw Common::Exception() << "failed to write " << path;
+	}
+
+	std::string generate(ANN const & nn) const {
+		int const numLayers = (int)nn.layers.size();
+		if (nn.loss.outputTransform && nn.loss.name != "softmaxCrossEntropy") {
+			throw Common::Exception() << "codegen doesn't know the output transform of loss " << nn.loss.name;
+		}
+		bool usesMath = nn.loss.outputTransform != nullptr;
+		std::vector<std::string> activations;
+		std::vector<Matrix> weights;
+		for (int k = 0; k < numLayers; ++k) {
+			auto const & layer = nn.layers[k];
+			if (layer.conv) throw Common::Exception() << "codegen not supported for conv layers";
+			activations.push_back(activation(layer.activation.name, "sum", usesMath));
+			if (layer.sparse) {
+				weights.emplace_back(layer.sparse->height, layer.sparse->width);
+				layer.sparse->toDense(weights.back());
+			} else {
+				weights.push_back(layer.w);
+			}
+		}
+
+		std::ostringstream o;
+		o << "#pragma once\n"
+			<< "// generated by NeuralNet::Codegen, don't edit\n";
+		if (usesMath) o << "#include <cmath>\n";
+		o << "\n"
+			<< "namespace " << name << " {\n"
+			<< "\n"
+			<< "using Real = " << typeName() << ";\n"
+			<< "\n"
+			<< "inline constexpr int numLayers = " << numLayers << ";\n"
+			<< "inline constexpr int inputSize = " << nn.layers[0].x.size << ";\n"
+			<< "inline constexpr int outputSize = " << nn.output.size << ";\n"
+			<< "inline constexpr int layerSizes[numLayers+1] = {" << nn.layers[0].x.size;
+		for (auto const & layer : nn.layers) o << ", " << layer.net.size;
+		o << "};\n";
+
+		for (int k = 0; k < numLayers; ++k) {
+			auto const & w = weights[k];
+			o << "\n"
+				<< "// layer " << k << ": " << w.width()-1 << " -> " << w.height() << ", " << nn.layers[k].activation.name << "\n"
+				<< "// rows are padded to " << w.storageWidth() << ", the bias is col " << w.width()-1 << "\n"
+				<< "alignas(64) inline constexpr Real w" << k << "[" << w.height() << "][" << w.storageWidth() << "] = {\n";
+			for (int i = 0; i < w.height(); ++i) {
+				o << "\t{";
+				for (int j = 0; j < w.width(); ++j) {
+					if (j) o << ", ";
+					o << literal(w[i][j]);
+				}
+				o << "},\n";
+			}
+			o << "};\n";
+		}
+
+		o << "\n"
+			<< "// y = outputSize Reals from x = inputSize Reals\n"
+			<< (usesMath ? "inline" : "constexpr") << " void forward(Real const * x, Real * y) {\n";
+		for (int k = 0; k < numLayers; ++k) {
+			auto const & w = weights[k];
+			int const height = w.height();
+			int const width = w.width();
+			int const sizeIn = width - 1;
+			bool const last = k == numLayers-1;
+			bool const unroll = height * width <= unrollLimit;
+			// what this layer reads from: the caller's x for layer 0, else the last layer's padded output
+			// loops read whole padded rows, so they want a padded input with the bias 1 in it
+			std::string in = k == 0 ? "x" : "h" + std::to_string(k);
+			if (k == 0 && !unroll) {
+				o << "\talignas(64) Real x0[" << w.storageWidth() << "] = {};\n"
+					<< "\tfor (int j = 0; j < " << sizeIn << "; ++j) x0[j] = x[j];\n"
+					<< "\tx0[" << sizeIn << "] = 1;\n";
+				in = "x0";
+			}
+			std::string const out = last ? "y" : "h" + std::to_string(k+1);
+			if (!last) {
+				// the next layer's input, padded like its rows, with its bias 1 in place
+				o << "\talignas(64) Real " << out << "[" << weights[k+1].storageWidth() << "] = {};\n"
+					<< "\t" << out << "[" << height << "] = 1;\n";
+			}
+			o << "\t// layer " << k << "\n";
+			if (unroll) {
+				for (int i = 0; i < height; ++i) {
+					o << "\t{\n"
+						<< "\t\tReal const sum = w" << k << "[" << i << "][" << sizeIn << "]";
+					for (int j = 0; j < sizeIn; ++j) {
+						if (w[i][j] == Real()) continue;
+						o << "\n\t\t\t+ w" << k << "[" << i << "][" << j << "] * " << in << "[" << j << "]";
+					}
+					o << ";\n"
+						<< "\t\t" << out << "[" << i << "] = " << activations[k] << ";\n"
+						<< "\t}\n";
+				}
+			} else {
+				o << "\tfor (int i = 0; i < " << height << "; ++i) {\n"
+					<< "\t\tReal acc[8] = {};\n"
+					<< "\t\tfor (int j = 0; j < " << w.storageWidth() << "; j += 8) {\n"
+					<< "\t\t\tfor (int l = 0; l < 8; ++l) acc[l] += w" << k << "[i][j+l] * " << in << "[j+l];\n"
+					<< "\t\t}\n"
+					<< "\t\tReal const sum = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));\n"
+					<< "\t\t" << out << "[i] = " << activations[k] << ";\n"
+					<< "\t}\n";
+			}
+		}
+		if (nn.loss.outputTransform) {
+			// softmax, same as Loss::softmaxCrossEntropy
+			o << "\t// softmax\n"
+				<< "\tReal maxY = y[0];\n"
+				<< "\tfor (int i = 1; i < outputSize; ++i) maxY = y[i] > maxY ? y[i] : maxY;\n"
+				<< "\tReal sum = {};\n"
+				<< "\tfor (int i = 0; i < outputSize; ++i) {\n"
+				<< "\t\ty[i] = std::exp(y[i] - maxY);\n"
+				<< "\t\tsum += y[i];\n"
+				<< "\t}\n"
+				<< "\tReal const invSum = Real(1) / sum;\n"
+				<< "\tfor (int i = 0; i < outputSize; ++i) y[i] *= invSum;\n";
+		}
+		o << "}\n"
+			<< "\n"
+			<< "}\n";
+		return o.str();
+	}
+
+	// C++ for activation 'name' of 'x', same as Activation<>::all()
+	// sets usesMath if it needs <cmath>
+	static std::string activation(std::string const & name, std::string const & x, bool & usesMath) {
+		if (name == "identity") return x;
+		if (name == "tanh") {
+			usesMath = true;
+			return "std::tanh(" + x + ")";
+		}
+		if (name == "sigmoid") {
+			usesMath = true;
+			return "Real(1) / (Real(1) + std::exp(-" + x + "))";
+		}
+		if (name == "poorLinearTanh") {
+			return x + " < Real(-1) ? Real(-1) : " + x + " > Real(1) ? Real(1) : " + x;
+		}
+		if (name == "poorQuadraticTanh") {
+			return x + " < Real(-2) ? Real(-1)"
+				" : " + x + " < Real(0) ? " + x + " * (Real(1) + Real(.25) * " + x + ")"
+				" : " + x + " < Real(2) ? " + x + " * (Real(1) - Real(.25) * " + x + ")"
+				" : Real(1)";
+		}
+		if (name == "poorCubicTanh") {
+			return x + " < Real(-2.5) ? Real(-1)"
+				" : " + x + " < Real(0) ? " + x + " * (Real(1) + " + x + " * (Real(0.32) + " + x + " * Real(0.032)))"
+				" : " + x + " < Real(2.5) ? " + x + " * (Real(1) + " + x + " * (Real(-0.32) + " + x + " * Real(0.032)))"
+				" : Real(1)";
+		}
+		if (name == "ReLU") return x + " < Real(0) ? Real(0) : " + x;
+		throw Common::Exception() << "codegen doesn't know activation " << (name.empty() ? "(unnamed)" : name);
+	}
+
+protected:
+	// by precision, so std::float64_t and friends come out as the builtin type they match
+	static char const * typeName() {
+		constexpr int digits = std::numeric_limits<Real>::digits;
+		if constexpr (digits == std::numeric_limits<float>::digits) return "float";
+		else if constexpr (digits == std::numeric_limits<double>::digits) return "double";
+		else if constexpr (digits == std::numeric_limits<long double>::digits) return "long double";
+		else throw Common::Exception() << "codegen doesn't know a builtin type with " << digits << " bits of mantissa";
+	}
+
+	// max_digits10 round-trips exactly
+	static std::string literal(Real x) {
+		if (!std::isfinite(x)) throw Common::Exception() << "codegen can't write the non-finite weight " << x;
+		std::ostringstream o;
+		o << std::setprecision(std::numeric_limits<Real>::max_digits10) << (long double)x;
+		std::string s = o.str();
+		if (s.find_first_of(".eE") == std::string::npos) s += ".";
+		constexpr int digits = std::numeric_limits<Real>::digits;
+		if constexpr (digits == std::numeric_limits<float>::digits) s += "f";
+		else if constexpr (digits == std::numeric_limits<long double>::digits && digits != std::numeric_limits<double>::digits) s += "L";
+		return s;
+	}
+};
+
+}
@@ -0,0 +1,200 @@
+#pragma once
+/*
+convolution layers
+x and net are stored channel-major, i.e. x[c][y][x] = x[x + inWidth * (y + inHeight * c)]
+weights are one row per output channel: kernel[c][ky][kx] packed the same way, then the bias, padded to 8 like any other Matrix
+1D convolutions are just inHeight = kernelHeight = 1
+
+forward = im2col: one row per output position holding the input patch (and a 1 for the bias),
+then every output is a row-dot-row of the weights and the patch, the same gemm as a batched dense layer.
+*/
+#include "NeuralNet/Kernels.h"
+#include "Common/Exception.h"
+#include <cstring>
+#include <cassert>
+
+namespace NeuralNet {
+
+struct ConvShape {
+	int inChannels = 1;
+	int inHeight = 1;
+	int inWidth = 1;
+	int outChannels = 1;
+	int kernelHeight = 1;
+	int kernelWidth = 1;
+	int strideY = 1;
+	int strideX = 1;
+	int padY = 0;
+	int padX = 0;
+
+	int outHeight() const { return (inHeight + 2 * padY - kernelHeight) / strideY + 1; }
+	int outWidth() const { return (inWidth + 2 * padX - kernelWidth) / strideX + 1; }
+	int numPositions() const { return outHeight() * outWidth(); }
+	int patchSize() const { return inChannels * kernelHeight * kernelWidth; }
+	int inSize() const { return inChannels * inHeight * inWidth; }
+	int outSize() const { return outChannels * numPositions(); }
+
+	void validate() const {
+		if (inChannels < 1 || inHeight < 1 || inWidth < 1 || outChannels < 1
+			|| kernelHeight < 1 || kernelWidth < 1 || strideY < 1 || strideX < 1
+			|| padY < 0 || padX < 0
+		) {
+			throw Common::Exception() << "invalid convolution shape";
+		}
+		if (outHeight() < 1 || outWidth() < 1) throw Common::Exception() << "convolution kernel is bigger than its padded input";
+	}
+};
+
+template<typename Real>
+struct Conv {
+	// fill one row of 'cols' per output position with that position's input patch
+	// cols is numPositions x (patchSize+1), the last column is the bias input
+	static void im2col(
+		ConvShape const & shape,
+		Real const * x,
+		Real * cols,
+		int const colsStorageWidth
+	) {
+		auto const outHeight = shape.outHeight();
+		auto const outWidth = shape.outWidth();
+		auto const patchSize = shape.patchSize();
+		auto row = cols;
+		for (int oy = 0; oy < outHeight; ++oy) {
+			for (int ox = 0; ox < outWidth; ++ox, row += colsStorageWidth) {
+				int k = 0;
+				for (int c = 0; c < shape.inChannels; ++c) {
+					auto const xc = x + shape.inWidth * shape.inHeight * c;
+					for (int ky = 0; ky < shape.kernelHeight; ++ky) {
+						int const iy = oy * shape.strideY - shape.padY + ky;
+						bool const yInside = iy >= 0 && iy < shape.inHeight;
+						for (int kx = 0; kx < shape.kernelWidth; ++kx, ++k) {
+							int const ix = ox * shape.strideX - shape.padX + kx;
+							row[k] = yInside && ix >= 0 && ix < shape.inWidth
+								? xc[ix + shape.inWidth * iy]
+								: Real();
+						}
+					}
+				}
+				row[patchSize] = 1;
+			}
+		}
+	}
+
+	// inverse of im2col for one output position: add its patch error back onto xErr
+	static void col2imAdd(
+		ConvShape const & shape,
+		int const p,
+		Real const * colErr,
+		Real * xErr
+	) {
+		int const oy = p / shape.outWidth();
+		int const ox = p % shape.outWidth();
+		int k = 0;
+		for (int c = 0; c < shape.inChannels; ++c) {
+			auto const xerrc = xErr + shape.inWidth * shape.inHeight * c;
+			for (int ky = 0; ky < shape.kernelHeight; ++ky) {
+				int const iy = oy * shape.strideY - shape.padY + ky;
+				bool const yInside = iy >= 0 && iy < shape.inHeight;
+				for (int kx = 0; kx < shape.kernelWidth; ++kx, ++k) {
+					int const ix = ox * shape.strideX - shape.padX + kx;
+					if (yInside && ix >= 0 && ix < shape.inWidth) {
+						xerrc[ix + shape.inWidth * iy] += colErr[k];
+					}
+				}
+			}
+		}
+	}
+
+	// net[oc][p] = w[oc] . cols[p], y = activation(net)
+	// expects cols already filled by im2col
+	static void forward(
+		auto const & layer,
+		auto const & cols,
+		Real * net,
+		Real * y
+	) {
+		auto const & shape = *layer.conv;
+		auto const & w = layer.w;
+		auto const storageWidth = w.storageWidth();
+		assert(cols.storageWidth() == storageWidth);
+		auto const numPositions = shape.numPositions();
+		// one im2col row per sample, outputs are channel-major
+		Kernels<Real>::gemm(
+			shape.outChannels,
+			storageWidth,
+			w.v.data(),
+			numPositions,
+			cols.v.data(),
+			storageWidth,
+			net,
+			numPositions,
+			1,
+			layer.kernels.forwardBatch
+		);
+		auto const & activation = layer.activation.f;
+		auto const outSize = shape.outSize();
+		for (int i = 0; i < outSize; ++i) {
+			y[i] = activation(net[i]);
+		}
+	}
+
+	// xErr = col2im(w^T netErr), using colErr (patchSize+1 wide) as scratch
+	static void backPropagateError(
+		auto const & layer,
+		Real const * netErr,
+		Real * xErr,
+		Real * colErr
+	) {
+		auto const & shape = *layer.conv;
+		auto const & w = layer.w;
+		auto const storageWidth = w.storageWidth();
+		auto const numPositions = shape.numPositions();
+		auto const patchSize = shape.patchSize();
+		std::memset(xErr, 0, sizeof(Real) * shape.inSize());
+		for (int p = 0; p < numPositions; ++p) {
+			std::memset(colErr, 0, sizeof(Real) * patchSize);
+			auto wi = w.v.data();
+			for (int oc = 0; oc < shape.outChannels; ++oc, wi += storageWidth) {
+				auto const neterr = netErr[p + numPositions * oc];
+				for (int k = 0; k < patchSize; ++k) {
+					colErr[k] += wi[k] * neterr;
+				}
+			}
+			col2imAdd(shape, p, colErr, xErr);
+		}
+	}
+
+	// dest[oc] += dt * sum_p netErr[oc][p] * cols[p] * mul.f(j)
+	// the weight gradient gemm, one im2col row per sample, same as a batched dense layer's update
+	// expects mul.beginLayer() already called, so dropout is one mask per column shared by every position
+	template<typename Mul>
+	static void backPropagateWeights(
+		Mul const & mul,
+		auto const & layer,
+		auto const & cols,
+		Real const * netErr,
+		Real * destwptr,
+		Real const dt
+	) {
+		auto const & shape = *layer.conv;
+		auto const storageWidth = layer.w.storageWidth();
+		assert(cols.storageWidth() == storageWidth);
+		auto const numPositions = shape.numPositions();
+		Kernels<Real>::gemmUpdate(
+			mul,
+			shape.outChannels,
+			storageWidth,
+			destwptr,
+			numPositions,
+			cols.v.data(),
+			storageWidth,
+			netErr,
+			numPositions,
+			1,
+			dt,
+			layer.kernels.backward
+		);
+	}
+};
+
+}
@@ -0,0 +1,245 @@
+#pragma once
+/*
+analytical cost of each phase of a layer, counted from the loops Kernels.h / Conv.h actually run
+
+flops include the padding columns the kernels multiply by zero, usefulFlops don't.
+bytes = every matrix and vector touched, counted once per call, except that batched forward re-reads the weights once per sample tile like Kernels::gemm does.
+that's what has to come from DRAM when nothing is cached, and the least that has to come from cache when everything is.
+activation functions are opaque std::functions, so they're counted as calls, not flops.
+
+	auto cost = nn.cost(batchSize);			// the whole net, ANN::layerCost(k) for one layer
+	auto roof = Roofline::measured<Real>();
+	double fraction = roof.time(cost.forward) / measuredSeconds;	// achieved fraction of roofline
+*/
+#include "NeuralNet/Kernels.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+namespace NeuralNet {
+
+struct Cost {
+	double flops = {};
+	double usefulFlops = {};
+	double bytes = {};
+	double activations = {};	// activation / activation-derivative calls
+	double randoms = {};		// random() draws, for dropout / dilution
+
+	// flops per byte
+	double intensity() const { return bytes > 0 ? flops / bytes : 0; }
+
+	Cost & operator+=(Cost const & o) {
+		flops += o.flops;
+		usefulFlops += o.usefulFlops;
+		bytes += o.bytes;
+		activations += o.activations;
+		randoms += o.randoms;
+		return *this;
+	}
+	Cost operator+(Cost const & o) const {
+		Cost r = *this;
+		return r += o;
+	}
+	Cost operator*(double s) const {
+		Cost r = *this;
+		r.flops *= s;
+		r.usefulFlops *= s;
+		r.bytes *= s;
+		r.activations *= s;
+		r.randoms *= s;
+		return r;
+	}
+};
+
+// one call of each phase
+struct LayerCost {
+	Cost forward;
+	Cost backward;	// netErr, xErr and the weight (or dw) update, i.e. one backPropagate
+	Cost update;	// one updateBatch, zero unless useBatch
+
+	LayerCost & operator+=(LayerCost const & o) {
+		forward += o.forward;
+		backward += o.backward;
+		update += o.update;
+		return *this;
+	}
+};
+
+// the time a cost takes if it's limited by either compute or memory
+struct Roofline {
+	// rough single-core defaults, use measured() for this machine
+	double peakFlops = 32e9;	// per second
+	double bandwidth = 10e9;	// bytes per second
+
+	double time(Cost const & c) const {
+		return std::max(c.flops / peakFlops, c.bytes / bandwidth);
+	}
+
+	// flops per byte above which a kernel is compute bound
+	double balance() const { return peakFlops / bandwidth; }
+
+	// one core: peak from an L1-resident Kernels::gemm, bandwidth from streaming arrays much bigger than cache
+	// takes a fraction of a second the first time, cached after
+	template<typename Real>
+	static Roofline const & measured() {
+		static Roofline const roof = measure<Real>();
+		return roof;
+	}
+
+	template<typename Real>
+	static Roofline measure() {
+		using Clock = std::chrono::steady_clock;
+		auto const best = [](auto && f) {
+			double t = {};
+			for (int trial = 0; trial < 5; ++trial) {
+				auto const start = Clock::now();
+				f();
+				double const dt = std::chrono::duration<double>(Clock::now() - start).count();
+				if (trial == 0 || dt < t) t = dt;
+			}
+			return t;
+		};
+		Roofline roof;
+		{
+			int const height = 16, storageWidth = 256, numSamples = 8, reps = 200;
+			std::vector<Real> w(height * storageWidth, Real(.5)), x(numSamples * storageWidth, Real(.5)), y(height * numSamples);
+			double const t = best([&]() {
+				for (int i = 0; i < reps; ++i) {
+					Kernels<Real>::gemm(height, storageWidth, w.data(), numSamples, x.data(), storageWidth, y.data(), 1, height);
+				}
+			});
+			volatile Real sink = y[0];
+			(void)sink;
+			roof.peakFlops = 2. * height * storageWidth * numSamples * reps / t;
+		}
+		{
+			size_t const n = (64 << 20) / sizeof(Real);
+			std::vector<Real> a(n, Real(1)), b(n, Real(2));
+			double const t = best([&]() {
+				for (size_t i = 0; i < n; ++i) {
+					a[i] += Real(.5) * b[i];
+				}
+			});
+			volatile Real sink = a[n/2];
+			(void)sink;
+			roof.bandwidth = 3. * sizeof(Real) * n / t;	// read a, read b, write a
+		}
+		return roof;
+	}
+};
+
+template<typename Real>
+struct CostModel {
+	// one layer, for 'numSamples' samples at once, the way the ANN's current settings would run it
+	static LayerCost layer(
+		auto const & layer,
+		int const numSamples,
+		bool const dropout,
+		bool const dilution,
+		bool const useBatch
+	) {
+		double const n = numSamples;
+		double const r = sizeof(Real);
+		LayerCost c;
+
+		if (layer.sparse) {
+			// every stored weight is a value and (per weight or per block) an int index
+			auto const & sw = *layer.sparse;
+			double const stored = sw.numStored();	// zeros inside kept Block8 blocks count the same as the rest
+			double const indexBytes = sizeof(int) * ((double)sw.index.size() + sw.rowStart.size());
+			double const ySize = layer.net.size;
+			double const xSize = layer.x.size;
+			c.forward.flops = 2. * stored * n;
+			c.forward.usefulFlops = c.forward.flops;
+			c.forward.bytes = n * (r * stored + indexBytes) + r * n * (xSize + 2. * ySize);
+			c.forward.activations = n * ySize;
+			// netErr, xErr scattered from the stored weights, then their update
+			c.backward.flops = n * ySize + 2. * stored * n + 3. * stored * n;
+			c.backward.usefulFlops = c.backward.flops;
+			c.backward.bytes = indexBytes + r * stored * (useBatch ? 3 : 2) + r * n * (4. * ySize + 2. * xSize);
+			c.backward.activations = n * ySize;
+			if (dilution) c.backward.randoms = stored * n;
+			if (dropout) c.backward.randoms += sw.width;
+			if (useBatch) {
+				c.update.flops = 2. * stored;
+				c.update.usefulFlops = 2. * stored;
+				c.update.bytes = r * 3. * stored + sizeof(int) * (double)sw.index.size();
+				if (dropout) c.update.randoms = sw.width;
+				else if (dilution) c.update.randoms = stored;
+			}
+			return c;
+		}
+
+		double const height = layer.w.height();
+		double const width = layer.w.width();
+		double const storageWidth = layer.w.storageWidth();
+		double const xSize = layer.x.size;
+		double const ySize = layer.net.size;
+
+		if (layer.conv) {
+			auto const & shape = *layer.conv;
+			double const positions = shape.numPositions();
+			double const patch = shape.patchSize();
+			double const samples = n * positions;	// gemm rows
+			// im2col, gemm, activation
+			c.forward.flops = 2. * height * storageWidth * samples;
+			c.forward.usefulFlops = 2. * height * width * samples;
+			c.forward.bytes = r * (n * xSize + 2. * samples * storageWidth + height * storageWidth + 2. * n * ySize);
+			c.forward.activations = n * ySize;
+
+			// netErr, xErr = col2im(w^T netErr), then every position's outer product into the weights
+			c.backward.flops = n * ySize
+				+ 2. * height * patch * samples + patch * samples
+				+ 3. * height * storageWidth * samples;
+			c.backward.usefulFlops = n * ySize
+				+ 2. * height * patch * samples + patch * samples
+				+ 3. * height * width * samples;
+			c.backward.bytes = r * (4. * n * ySize
+				+ height * storageWidth * (useBatch ? 3 : 2)
+				+ 2. * n * xSize
+				+ 2. * samples * storageWidth);
+			c.backward.activations = n * ySize;
+			// dilution rolls per weight per position, dropout uses the per-column mask below
+			if (dilution) c.backward.randoms = height * storageWidth * samples;
+		} else {
+			// Kernels::gemm re-reads the weights once per sample tile
+			int const sampleTile = std::max<int>(1, Kernels<Real>::tileBytesL2 / (int)(sizeof(Real) * std::min<int>((int)storageWidth, Kernels<Real>::tileWidth)));
+			double const weightPasses = std::ceil(n / sampleTile);
+			c.forward.flops = 2. * height * storageWidth * n;
+			c.forward.usefulFlops = 2. * height * width * n;
+			c.forward.bytes = r * (weightPasses * height * storageWidth + n * storageWidth + 2. * n * ySize);
+			c.forward.activations = n * ySize;
+
+			// the xErr loop stops at xSize rounded up to 8, the update runs the whole row
+			double const xErrEnd = (double)(((int)xSize + 7) & -8);
+			c.backward.flops = n * ySize
+				+ 2. * height * xErrEnd * n
+				+ 3. * height * storageWidth * n;
+			c.backward.usefulFlops = n * ySize
+				+ 2. * height * xSize * n
+				+ 3. * height * width * n;
+			// w read, destw read + written, which is the same memory unless batching into dw
+			c.backward.bytes = r * (4. * n * ySize
+				+ height * storageWidth * (useBatch ? 3 : 2)
+				+ n * storageWidth
+				+ 2. * n * xErrEnd);
+			c.backward.activations = n * ySize;
+			if (dilution) c.backward.randoms = height * storageWidth * n;
+		}
+		// dropout rolls one mask entry per column in beginLayer
+		if (dropout) c.backward.randoms += width;
+
+		if (useBatch) {
+			// w += dw * mul, dw = 0
+			c.update.flops = 2. * height * storageWidth;
+			c.update.usefulFlops = 2. * height * width;
+			c.update.bytes = r * 4. * height * storageWidth;
+			if (dropout) c.update.randoms = width;
+			else if (dilution) c.update.randoms = height * storageWidth;
+		}
+		return c;
+	}
+};
+
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include "NeuralNet/ANN.h"
+#include "NeuralNet/Numa.h"
+#include "Common/Exception.h"
+#include <vector>
+#include <deque>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace NeuralNet {
+
+/*
+serves one ANN to many client threads
+requests are coalesced into a batch until there are 'maxBatchSize' of them or the oldest has waited 'maxWait',
+then one batched feed-forward answers all of them.
+
+in-process:
+	InferenceServer<float> server(nn);
+	auto output = server.submit(input).get();
+
+out-of-process, after server.listen("/tmp/nn.sock"):
+	connect a SOCK_STREAM unix socket, write input.size raw Reals, read output.size raw Reals back, repeat.
+
+multi-socket: pass a workerCpu, i.e. from NumaTopology::cpuForWorker, to pin the batching thread there.
+its copy of the weights and its batch buffers are then allocated from that cpu, so they're on its node.
+*/
+template<typename Real = DefaultReal>
+struct InferenceServer {
+	using ANN = NeuralNet::ANN<Real>;
+	using Batch = NeuralNet::Batch<Real>;
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats {
+		double p50 = {};			// latency, seconds, from submit() to the result being ready
+		double p99 = {};
+		double avgBatchSize = {};
+		size_t requests = {};
+	};
+
+	int maxBatchSize = {};
+	std::chrono::microseconds maxWait = {};
+	int workerCpu = -1;	// -1 = not pinned
+
+	InferenceServer(
+		ANN nn_,
+		int maxBatchSize_ = 32,
+		std::chrono::microseconds maxWait_ = std::chrono::microseconds(200),
+		int workerCpu_ = -1
+	) :	maxBatchSize(maxBatchSize_),
+		maxWait(maxWait_),
+		workerCpu(workerCpu_),
+		nn(std::move(nn_)),
+		latencies(latencyWindow)
+	{
+		if (workerCpu < 0) {
+			batch = nn.newBatch(maxBatchSize);
+		} else {
+			// reallocate from the worker's cpu so first touch puts it on the worker's node
+			std::thread([this]() {
+				NumaTopology::pin(workerCpu);
+				nn = ANN(nn);
+				batch = nn.newBatch(maxBatchSize);
+			}).join();
+		}
+		worker = std::thread([this]() {
+			if (workerCpu >= 0) NumaTopology::pin(workerCpu);
+			serveLoop();
+		});
+	}
+
+	~InferenceServer() {
+		// stop taking socket clients first, they might be waiting on the worker
+		if (listenFd >= 0) {
+			::shutdown(listenFd, SHUT_RDWR);
+			::close(listenFd);
+			listenFd = -1;
+		}
+		if (acceptThread.joinable()) acceptThread.join();
+		// nothing adds connections now the accept thread is gone
+		{
+			std::lock_guard lock(connectionsMutex);
+			for (auto & connection : connections) {
+				if (!connection.finished) ::shutdown(connection.fd, SHUT_RDWR);
+			}
+		}
+		for (auto & connection : connections) {
+			connection.thread.join();
+		}
+		if (!socketPath.empty()) ::unlink(socketPath.c_str());
+
+		{
+			std::lock_guard lock(mutex);
+			done = true;
+		}
+		cv.notify_all();
+		worker.join();
+	}
+
+	int inputSize() const { return nn.layers[0].x.size; }
+	int outputSize() const { return nn.output.size; }
+
+	// any thread
+	std::future<std::vector<Real>> submit(std::vector<Real> input) {
+		if ((int)input.size() != inputSize()) throw Common::Exception() << "expected input size " << inputSize() << " but got " << input.size();
+		Request request;
+		request.input = std::move(input);
+		request.start = Clock::now();
+		auto result = request.promise.get_future();
+		{
+			std::lock_guard lock(mutex);
+			pending.push_back(std::move(request));
+		}
+		cv.notify_one();
+		return result;
+	}
+
+	Stats getStats() {
+		std::lock_guard lock(statsMutex);
+		Stats stats;
+		stats.requests = totalRequests;
+		stats.avgBatchSize = totalBatches ? (double)totalRequests / (double)totalBatches : 0;
+		auto n = std::min<size_t>(totalRequests, latencies.size());
+		if (n) {
+			std::vector<double> sorted(latencies.begin(), latencies.begin() + n);
+			std::sort(sorted.begin(), sorted.end());
+			stats.p50 = sorted[n / 2];
+			stats.p99 = sorted[std::min(n - 1, n * 99 / 100)];
+		}
+		return stats;
+	}
+
+	// also serve out-of-process clients on a unix socket
+	void listen(std::string const & path) {
+		if (listenFd >= 0) throw Common::Exception() << "already listening on " << socketPath;
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) throw Common::Exception() << "socket path too long: " << path;
+		std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+		int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) throw Common::Exception() << "socket() failed: " << std::strerror(errno);
+		::unlink(path.c_str());
+		if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0
+			|| ::listen(fd, 16) < 0
+		) {
+			auto err = errno;
+			::close(fd);
+			throw Common::Exception() << "failed to listen on " << path << ": " << std::strerror(err);
+		}
+		listenFd = fd;
+		socketPath = path;
+		// by value, the dtor closes and clears listenFd while the accept thread is blocked on it
+		acceptThread = std::thread([this, fd]() { acceptLoop(fd); });
+	}
+
+protected:
+	struct Request {
+		std::vector<Real> input;
+		std::promise<std::vector<Real>> promise;
+		Clock::time_point start;
+	};
+
+	ANN nn;
+	Batch batch;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<Request> pending;
+	bool done = false;
+	std::thread worker;
+
+	static constexpr size_t latencyWindow = 1 << 14;	// percentiles are over the most recent requests
+	std::mutex statsMutex;
+	std::vector<double> latencies;
+	size_t totalRequests = {};
+	size_t totalBatches = {};
+
+	int listenFd = -1;
+	std::string socketPath;
+	std::thread acceptThread;
+
+	struct Connection {
+		int fd = -1;
+		bool finished = false;	// its thread closed fd and is exiting, so join it
+		std::thread thread;
+	};
+	std::mutex connectionsMutex;
+	std::list<Connection> connections;	// list so each thread's entry stays put while others come and go
+
+	void serveLoop() {
+		std::vector<Request> requests;
+		requests.reserve(maxBatchSize);
+		for (;;) {
+			{
+				std::unique_lock lock(mutex);
+				cv.wait(lock, [&]() { return done || !pending.empty(); });
+				if (done) break;
+				// wait for a full batch or until the oldest request runs out of time
+				auto const deadline = pending.front().start + maxWait;
+				cv.wait_until(lock, deadline, [&]() { return done || (int)pending.size() >= maxBatchSize; });
+				int const n = std::min<int>(maxBatchSize, (int)pending.size());
+				for (int r = 0; r < n; ++r) {
+					requests.push_back(std::move(pending.front()));
+					pending.pop_front();
+				}
+			}
+
+			// the batch matrices are allocated for maxBatchSize rows, only run the ones in use
+			int const n = (int)requests.size();
+			batch.size = n;
+			for (int r = 0; r < n; ++r) {
+				std::copy(requests[r].input.begin(), requests[r].input.end(), batch.input()[r].v);
+			}
+			nn.feedForward(batch);
+
+			auto const end = Clock::now();
+			auto const outputSize_ = outputSize();
+			{
+				std::lock_guard lock(statsMutex);
+				for (int r = 0; r < n; ++r) {
+					latencies[(totalRequests + r) % latencies.size()] = std::chrono::duration<double>(end - requests[r].start).count();
+				}
+				totalRequests += n;
+				++totalBatches;
+			}
+			for (int r = 0; r < n; ++r) {
+				auto const outputr = batch.output[r].v;
+				requests[r].promise.set_value(std::vector<Real>(outputr, outputr + outputSize_));
+			}
+			requests.clear();
+		}
+	}
+
+	static bool readAll(int fd, void * dst, size_t n) {
+		auto p = (char*)dst;
+		while (n) {
+			auto got = ::read(fd, p, n);
+			if (got < 0 && errno == EINTR) continue;
+			if (got <= 0) return false;
+			p += got;
+			n -= got;
+		}
+		return true;
+	}
+
+	// false = the client went away (EPIPE etc), drop the connection
+	// send with MSG_NOSIGNAL so a client that disconnects before its reply doesn't SIGPIPE the whole process
+	// where there's no MSG_NOSIGNAL (osx) the socket gets SO_NOSIGPIPE in acceptLoop instead
+	static bool writeAll(int fd, void const * src, size_t n) {
+		auto p = (char const *)src;
+		while (n) {
+#if defined(MSG_NOSIGNAL)
+			auto sent = ::send(fd, p, n, MSG_NOSIGNAL);
+#else
+			auto sent = ::send(fd, p, n, 0);
+#endif
+			if (sent < 0 && errno == EINTR) continue;
+			if (sent <= 0) return false;
+			p += sent;
+			n -= sent;
+		}
+		return true;
+	}
+
+	void acceptLoop(int const listenFd_) {
+		for (;;) {
+			int fd = ::accept(listenFd_, nullptr, nullptr);
+			if (fd < 0) {
+				if (errno == EINTR) continue;
+				break;	// closed by the dtor
+			}
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+			int const one = 1;
+			::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+			std::lock_guard lock(connectionsMutex);
+			// join whichever clients have hung up since the last accept, so short-lived clients don't pile up threads
+			for (auto i = connections.begin(); i != connections.end();) {
+				if (!i->finished) {
+					++i;
+					continue;
+				}
+				i->thread.join();
+				i = connections.erase(i);
+			}
+			auto & connection = connections.emplace_back();
+			connection.fd = fd;
+			connection.thread = std::thread([this, fd, &connection]() {
+				std::vector<Real> input(inputSize());
+				while (readAll(fd, input.data(), sizeof(Real) * input.size())) {
+					auto output = submit(input).get();
+					if (!writeAll(fd, output.data(), sizeof(Real) * output.size())) break;
+				}
+				std::lock_guard lock(connectionsMutex);
+				::close(fd);
+				connection.finished = true;
+			});
+		}
+	}
+};
+
+}
@@ -0,0 +1,533 @@
+#pragma once
+/*
+the inner loops everything else runs on
+all matrices are row-major with rows padded to a multiple of 8, padding is zero, same as NeuralNet::Matrix
+
+everything goes 8 Reals at a time through Lanes<Real>, with one set of 8 independent accumulators per output,
+so there's no single serial add chain.
+
+register blocking: when 8 Reals fill a native vector register, each microkernel works on 'rowBlock' weight rows
+(and for gemm 'sampleBlock' samples) at once so every x load is shared by several rows.
+without one, the compiler does better vectorizing one row at a time on its own, so rowBlock = sampleBlock = 1.
+
+cache tiling: columns are walked 'tileWidth' at a time so that slice of x stays in L1 while the weights stream past,
+and gemm walks samples 'sampleTile' at a time so those rows of X stay in L2 while every weight row goes over them.
+
+those are only the defaults.  every kernel takes a KernelVariant to override them, i.e. with what Autotune.h measured for that layer.
+*/
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cassert>
+
+namespace NeuralNet {
+
+// 8 Reals operated on together, as a plain array
+template<typename Real, typename Enable = void>
+struct Lanes {
+	static constexpr bool native = false;
+	struct type {
+		Real v[8];
+	};
+	static type zero() { return {}; }
+	static type set(Real x) {
+		type r;
+		for (int l = 0; l < 8; ++l) r.v[l] = x;
+		return r;
+	}
+	static type load(Real const * p) {
+		type r;
+		for (int l = 0; l < 8; ++l) r.v[l] = p[l];
+		return r;
+	}
+	static void store(Real * p, type const & a) {
+		for (int l = 0; l < 8; ++l) p[l] = a.v[l];
+	}
+	static type add(type const & a, type const & b) {
+		type r;
+		for (int l = 0; l < 8; ++l) r.v[l] = a.v[l] + b.v[l];
+		return r;
+	}
+	static type mul(type const & a, type const & b) {
+		type r;
+		for (int l = 0; l < 8; ++l) r.v[l] = a.v[l] * b.v[l];
+		return r;
+	}
+	// acc += a * b
+	static void madd(type & acc, type const & a, type const & b) {
+		for (int l = 0; l < 8; ++l) acc.v[l] += a.v[l] * b.v[l];
+	}
+	static Real sum(type const & a) {
+		return ((a.v[0] + a.v[1]) + (a.v[2] + a.v[3]))
+			+ ((a.v[4] + a.v[5]) + (a.v[6] + a.v[7]));
+	}
+};
+
+#if defined(__GNUC__) && (defined(__AVX__) || defined(__AVX512F__))
+// 8 Reals = one native vector register: float on AVX, double on AVX-512
+// GCC / clang vector extensions, so the compiler can't spread the accumulators across lanes some other way
+template<typename Real>
+struct Lanes<Real, std::enable_if_t<
+	(std::is_same_v<Real, float>
+#if defined(__AVX512F__)
+	|| std::is_same_v<Real, double>
+#endif
+	)
+>> {
+	static constexpr bool native = true;
+	typedef Real type __attribute__((vector_size(8 * sizeof(Real))));
+	static type zero() { return type{}; }
+	static type set(Real x) { return type{} + x; }
+	static type load(Real const * p) {
+		type r;
+		std::memcpy(&r, p, sizeof(r));
+		return r;
+	}
+	static void store(Real * p, type const & a) {
+		std::memcpy(p, &a, sizeof(a));
+	}
+	static type add(type const & a, type const & b) { return a + b; }
+	static type mul(type const & a, type const & b) { return a * b; }
+	static void madd(type & acc, type const & a, type const & b) { acc += a * b; }
+	static Real sum(type const & a) {
+		return ((a[0] + a[1]) + (a[2] + a[3]))
+			+ ((a[4] + a[5]) + (a[6] + a[7]));
+	}
+};
+#endif
+
+// how to block and tile a kernel call, 0 = Kernels<Real>'s default
+// rowBlock and sampleBlock can be 1, 2 or 4
+struct KernelVariant {
+	int rowBlock = 0;
+	int sampleBlock = 0;
+	int tileWidth = 0;
+
+	bool operator==(KernelVariant const &) const = default;
+};
+
+// one per Layer
+struct LayerKernels {
+	KernelVariant forward;			// one sample
+	KernelVariant forwardBatch;		// many samples, also used by convolutions
+	KernelVariant backward;
+};
+
+template<typename Real>
+struct Kernels {
+	using L = Lanes<Real>;
+	using Lane = typename L::type;
+
+	static constexpr int rowBlock = L::native ? 4 : 1;
+	static constexpr int sampleBlock = L::native ? 2 : 1;
+	static constexpr int tileWidth = (16 << 10) / sizeof(Real);		// 16k of each x row in L1
+	static constexpr int tileBytesL2 = 256 << 10;
+
+	static_assert(tileWidth % 8 == 0);
+
+	// fill in the defaults
+	static KernelVariant resolve(KernelVariant v) {
+		if (!v.rowBlock) v.rowBlock = rowBlock;
+		if (!v.sampleBlock) v.sampleBlock = sampleBlock;
+		if (!v.tileWidth) v.tileWidth = tileWidth;
+		assert(v.tileWidth % 8 == 0);
+		return v;
+	}
+
+	// calls f.template operator()<R>() with R = n as a constant, for n = 1, 2 or 4
+	template<typename F>
+	static void withBlock(int const n, F && f) {
+		switch (n) {
+		case 4: f.template operator()<4>(); break;
+		case 2: f.template operator()<2>(); break;
+		default: f.template operator()<1>(); break;
+		}
+	}
+
+	// mul.f(j+l) for each lane
+	template<typename Mul>
+	static Lane mulLanes(Mul const & mul, int const j) {
+		Real m[8];
+		for (int l = 0; l < 8; ++l) m[l] = mul.f(j+l);
+		return L::load(m);
+	}
+
+	// y[i * yRowStride + r * ySampleStride] (+)= w[i] . x[r] for R rows and S samples starting at i, r, over cols [j0,j1)
+	template<int R, int S>
+	static void microkernel(
+		int const i,
+		int const r,
+		int const j0,
+		int const j1,
+		bool const accumulate,
+		Real const * const wptr,
+		int const storageWidth,
+		Real const * const xptr,
+		int const xStride,
+		Real * const yptr,
+		int const yRowStride,
+		int const ySampleStride
+	) {
+		Real const * w[R];
+		Real const * x[S];
+		for (int a = 0; a < R; ++a) w[a] = wptr + storageWidth * (i + a);
+		for (int b = 0; b < S; ++b) x[b] = xptr + xStride * (r + b);
+		Lane acc[R][S];
+		for (int a = 0; a < R; ++a) {
+			for (int b = 0; b < S; ++b) {
+				acc[a][b] = L::zero();
+			}
+		}
+		for (int j = j0; j < j1; j += 8) {
+			Lane xj[S];
+			for (int b = 0; b < S; ++b) xj[b] = L::load(x[b] + j);
+			for (int a = 0; a < R; ++a) {
+				Lane const wj = L::load(w[a] + j);
+				for (int b = 0; b < S; ++b) {
+					L::madd(acc[a][b], wj, xj[b]);
+				}
+			}
+		}
+		for (int a = 0; a < R; ++a) {
+			for (int b = 0; b < S; ++b) {
+				auto & yab = yptr[yRowStride * (i + a) + ySampleStride * (r + b)];
+				if (accumulate) {
+					yab += L::sum(acc[a][b]);
+				} else {
+					yab = L::sum(acc[a][b]);
+				}
+			}
+		}
+	}
+
+	// y[i] = w[i] . x for i < height
+	// writes exactly 'height' values
+	static void gemv(
+		int const height,
+		int const storageWidth,
+		Real const * const w,
+		Real const * const x,
+		Real * const y,
+		KernelVariant const & variant = {}
+	) {
+		gemm(height, storageWidth, w, 1, x, storageWidth, y, 1, 0, variant);
+	}
+
+	// y[i * yRowStride + r * ySampleStride] = w[i] . x[r] for i < height, r < numSamples
+	// batched forward is yRowStride = 1, ySampleStride = the output row's storage width
+	// convolution forward is yRowStride = numPositions, ySampleStride = 1, one sample per im2col row
+	// writes exactly height x numSamples values, so it won't touch padding or bias slots
+	static void gemm(
+		int const height,
+		int const storageWidth,
+		Real const * const w,
+		int const numSamples,
+		Real const * const x,
+		int const xStride,
+		Real * const y,
+		int const yRowStride,
+		int const ySampleStride,
+		KernelVariant const & variant_ = {}
+	) {
+		auto const variant = resolve(variant_);
+		withBlock(variant.rowBlock, [&]<int R>() {
+			withBlock(numSamples == 1 ? 1 : variant.sampleBlock, [&]<int S>() {
+				gemmBlocked<R, S>(height, storageWidth, w, numSamples, x, xStride, y, yRowStride, ySampleStride, variant.tileWidth);
+			});
+		});
+	}
+
+	template<int R, int S>
+	static void gemmBlocked(
+		int const height,
+		int const storageWidth,
+		Real const * const w,
+		int const numSamples,
+		Real const * const x,
+		int const xStride,
+		Real * const y,
+		int const yRowStride,
+		int const ySampleStride,
+		int const tileWidth_
+	) {
+		assert(storageWidth % 8 == 0);
+		int const sampleTile = std::max<int>(S, tileBytesL2 / (int)(sizeof(Real) * std::min(storageWidth, tileWidth_)));
+		int const fullRows = height - height % R;
+		for (int j0 = 0; j0 < storageWidth; j0 += tileWidth_) {
+			int const j1 = std::min(storageWidth, j0 + tileWidth_);
+			bool const accumulate = j0 > 0;
+			for (int r0 = 0; r0 < numSamples; r0 += sampleTile) {
+				int const r1 = std::min(numSamples, r0 + sampleTile);
+				int const fullSamples = r1 - (r1 - r0) % S;
+				for (int i = 0; i < fullRows; i += R) {
+					int r = r0;
+					for (; r < fullSamples; r += S) {
+						microkernel<R, S>(i, r, j0, j1, accumulate, w, storageWidth, x, xStride, y, yRowStride, ySampleStride);
+					}
+					for (; r < r1; ++r) {
+						microkernel<R, 1>(i, r, j0, j1, accumulate, w, storageWidth, x, xStride, y, yRowStride, ySampleStride);
+					}
+				}
+				for (int i = fullRows; i < height; ++i) {
+					int r = r0;
+					for (; r < fullSamples; r += S) {
+						microkernel<1, S>(i, r, j0, j1, accumulate, w, storageWidth, x, xStride, y, yRowStride, ySampleStride);
+					}
+					for (; r < r1; ++r) {
+						microkernel<1, 1>(i, r, j0, j1, accumulate, w, storageWidth, x, xStride, y, yRowStride, ySampleStride);
+					}
+				}
+			}
+		}
+	}
+
+	// the whole backward step of a dense layer in one pass over its weights:
+	//	xErr = netErr * w, using the weights from before this update
+	//	destw += dt * netErr ⊗ x * mul.f(j), where destw is either w or the batch dw
+	// rows go 'rowBlock' at a time so each x and xErr load is shared by all of them
+	template<typename Mul>
+	static void backward(
+		Mul const & mul,
+		int const height,
+		int const storageWidth,
+		Real const * const wptr,
+		Real * const destwptr,
+		Real const * const xptr,
+		Real const * const neterrptr,
+		Real * const xerrptr,
+		int const xErrSize,
+		Real const dt,
+		KernelVariant const & variant = {}
+	) {
+		backwardBatch(mul, height, storageWidth, wptr, destwptr, 1, xptr, storageWidth, neterrptr, 0, xerrptr, storageWidth, xErrSize, dt, variant);
+	}
+
+	// same for one sample but only rows[0..numRows) of w, the other rows' netErr being zero
+	// i.e. a Q update where only the action taken has an error
+	template<typename Mul>
+	static void backwardSparse(
+		Mul const & mul,
+		int const * const rows,
+		int const numRows,
+		int const storageWidth,
+		Real const * const wptr,
+		Real * const destwptr,
+		Real const * const xptr,
+		Real const * const neterrptr,
+		Real * const xerrptr,
+		int const xErrSize,
+		Real const dt
+	) {
+		int const xErrEnd = (xErrSize + 7) & -8;
+		std::memset(xerrptr, 0, sizeof(Real) * xErrEnd);
+		for (int r = 0; r < numRows; ++r) {
+			backwardRows<1>(mul, rows[r], storageWidth, wptr, destwptr, 1, xptr, storageWidth, neterrptr, 0, xerrptr, storageWidth, xErrEnd, dt);
+		}
+		for (int j = xErrSize; j < xErrEnd; ++j) {
+			xerrptr[j] = {};
+		}
+	}
+
+	// same for 'numSamples' samples at once, each row of x / netErr / xErr is one sample
+	// every sample's xErr is accumulated from a block of weight rows before any sample updates them
+	// so each weight row is read from memory once per batch
+	template<typename Mul>
+	static void backwardBatch(
+		Mul const & mul,
+		int const height,
+		int const storageWidth,
+		Real const * const wptr,
+		Real * const destwptr,
+		int const numSamples,
+		Real const * const xptr,
+		int const xStride,
+		Real const * const neterrptr,
+		int const netErrStride,
+		Real * const xerrptr,
+		int const xErrStride,
+		int const xErrSize,
+		Real const dt,
+		KernelVariant const & variant = {}
+	) {
+		// xErr only gets written up to its size rounded up to 8, past that is the bias col
+		int const xErrEnd = (xErrSize + 7) & -8;
+		assert(xErrEnd <= xErrStride);
+		for (int r = 0; r < numSamples; ++r) {
+			std::memset(xerrptr + xErrStride * r, 0, sizeof(Real) * xErrEnd);
+		}
+		withBlock(resolve(variant).rowBlock, [&]<int R>() {
+			int const fullRows = height - height % R;
+			int i = 0;
+			for (; i < fullRows; i += R) {
+				backwardRows<R>(mul, i, storageWidth, wptr, destwptr, numSamples, xptr, xStride, neterrptr, netErrStride, xerrptr, xErrStride, xErrEnd, dt);
+			}
+			for (; i < height; ++i) {
+				backwardRows<1>(mul, i, storageWidth, wptr, destwptr, numSamples, xptr, xStride, neterrptr, netErrStride, xerrptr, xErrStride, xErrEnd, dt);
+			}
+		});
+		// whatever the bias col put in the xErr padding
+		for (int r = 0; r < numSamples; ++r) {
+			for (int j = xErrSize; j < xErrEnd; ++j) {
+				xerrptr[j + xErrStride * r] = {};
+			}
+		}
+	}
+
+	template<int R, typename Mul>
+	static void backwardRows(
+		Mul const & mul,
+		int const i,
+		int const storageWidth,
+		Real const * const wptr,
+		Real * const destwptr,
+		int const numSamples,
+		Real const * const xptr,
+		int const xStride,
+		Real const * const neterrptr,
+		int const netErrStride,
+		Real * const xerrptr,
+		int const xErrStride,
+		int const xErrEnd,
+		Real const dt
+	) {
+		Real const * w[R];
+		Real * destw[R];
+		for (int a = 0; a < R; ++a) {
+			w[a] = wptr + storageWidth * (i + a);
+			destw[a] = destwptr + storageWidth * (i + a);
+		}
+		// one sample: read w and write destw in the same loop, they're the same memory when not batching
+		// more: every sample's xErr first, with the pre-update rows, then the updates while the rows are still in cache
+		bool const fused = numSamples == 1;
+		for (int r = 0; r < numSamples; ++r) {
+			Lane neterr[R], neterrdt[R];
+			for (int a = 0; a < R; ++a) {
+				auto const e = neterrptr[i + a + netErrStride * r];
+				neterr[a] = L::set(e);
+				neterrdt[a] = L::set(dt * e);
+			}
+			auto const xr = xptr + xStride * r;
+			auto const xerrr = xerrptr + xErrStride * r;
+			int j = 0;
+			for (; j < xErrEnd; j += 8) {
+				Lane xerrj = L::load(xerrr + j);
+				for (int a = 0; a < R; ++a) {
+					L::madd(xerrj, L::load(w[a] + j), neterr[a]);
+				}
+				L::store(xerrr + j, xerrj);
+				if (fused) {
+					Lane const xj = L::load(xr + j);
+					for (int a = 0; a < R; ++a) {
+						Lane destwj = L::load(destw[a] + j);
+						L::madd(destwj, neterrdt[a], L::mul(xj, mulLanes(mul, j)));
+						L::store(destw[a] + j, destwj);
+					}
+				}
+			}
+			// the rest of the row is just the bias col and padding
+			if (fused) {
+				for (; j < storageWidth; j += 8) {
+					Lane const xj = L::load(xr + j);
+					for (int a = 0; a < R; ++a) {
+						Lane destwj = L::load(destw[a] + j);
+						L::madd(destwj, neterrdt[a], L::mul(xj, mulLanes(mul, j)));
+						L::store(destw[a] + j, destwj);
+					}
+				}
+			}
+		}
+		if (fused) return;
+		updateRows<R>(mul, i, storageWidth, destwptr, 0, numSamples, xptr, xStride, neterrptr, 1, netErrStride, dt);
+	}
+
+	// destw[i] += dt * sum_r netErr[i * netErrRowStride + r * netErrSampleStride] * x[r] * mul.f(j) for i < height, r < numSamples
+	// the weight half of backwardBatch, for when xErr is done some other way
+	// convolutions are netErrRowStride = numPositions, netErrSampleStride = 1, one sample per im2col row
+	// samples go 'sampleTile' at a time like gemm, so those rows of x stay in L2 while every weight row goes over them
+	template<typename Mul>
+	static void gemmUpdate(
+		Mul const & mul,
+		int const height,
+		int const storageWidth,
+		Real * const destwptr,
+		int const numSamples,
+		Real const * const xptr,
+		int const xStride,
+		Real const * const neterrptr,
+		int const netErrRowStride,
+		int const netErrSampleStride,
+		Real const dt,
+		KernelVariant const & variant_ = {}
+	) {
+		auto const variant = resolve(variant_);
+		int const sampleTile = std::max<int>(1, tileBytesL2 / (int)(sizeof(Real) * std::min(storageWidth, variant.tileWidth)));
+		withBlock(variant.rowBlock, [&]<int R>() {
+			int const fullRows = height - height % R;
+			for (int r0 = 0; r0 < numSamples; r0 += sampleTile) {
+				int const r1 = std::min(numSamples, r0 + sampleTile);
+				int i = 0;
+				for (; i < fullRows; i += R) {
+					updateRows<R>(mul, i, storageWidth, destwptr, r0, r1, xptr, xStride, neterrptr, netErrRowStride, netErrSampleStride, dt);
+				}
+				for (; i < height; ++i) {
+					updateRows<1>(mul, i, storageWidth, destwptr, r0, r1, xptr, xStride, neterrptr, netErrRowStride, netErrSampleStride, dt);
+				}
+			}
+		});
+	}
+
+	// rows [i,i+R) of gemmUpdate for samples [r0,r1), each destw load and store shared by all the samples
+	template<int R, typename Mul>
+	static void updateRows(
+		Mul const & mul,
+		int const i,
+		int const storageWidth,
+		Real * const destwptr,
+		int const r0,
+		int const r1,
+		Real const * const xptr,
+		int const xStride,
+		Real const * const neterrptr,
+		int const netErrRowStride,
+		int const netErrSampleStride,
+		Real const dt
+	) {
+		Real * destw[R];
+		for (int a = 0; a < R; ++a) destw[a] = destwptr + storageWidth * (i + a);
+		for (int j = 0; j < storageWidth; j += 8) {
+			Lane destwj[R];
+			for (int a = 0; a < R; ++a) destwj[a] = L::load(destw[a] + j);
+			for (int r = r0; r < r1; ++r) {
+				Lane const xj = L::load(xptr + xStride * r + j);
+				for (int a = 0; a < R; ++a) {
+					L::madd(destwj[a], L::set(dt * neterrptr[netErrRowStride * (i + a) + netErrSampleStride * r]), L::mul(xj, mulLanes(mul, j)));
+				}
+			}
+			for (int a = 0; a < R; ++a) L::store(destw[a] + j, destwj[a]);
+		}
+	}
+
+	// w += dw * mul.f(j), and clear dw in the same pass
+	template<typename Mul>
+	static void updateBatch(
+		Mul const & mul,
+		int const height,
+		int const storageWidth,
+		Real * wptr,
+		Real * dwptr
+	) {
+		for (int i = 0; i < height; ++i,
+			wptr += storageWidth,
+			dwptr += storageWidth
+		) {
+			for (int j = 0; j < storageWidth; j += 8) {
+				for (int l = 0; l < 8; ++l) {
+					wptr[j+l] += dwptr[j+l] * mul.f(j+l);
+					dwptr[j+l] = {};
+				}
+			}
+		}
+	}
+};
+
+}
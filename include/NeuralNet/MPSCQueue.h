@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Common/Exception.h"
+#include "NeuralNet/ANN.h"	// ispowerof2
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace NeuralNet {
+
+/*
+bounded lock-free multiple-producer single-consumer queue
+each cell carries a sequence number that says whose turn it is:
+	seq == pos		=> free for the producer that claims 'pos'
+	seq == pos+1	=> filled, ready for the consumer
+producers claim slots with a CAS on 'tail', the consumer owns 'head'
+*/
+template<typename T>
+struct MPSCQueue {
+	struct Cell {
+		std::atomic<size_t> seq;
+		T value;
+	};
+
+	std::vector<Cell> cells;
+	size_t mask = {};
+
+	alignas(64) std::atomic<size_t> tail = {};	// next slot a producer claims
+	alignas(64) std::atomic<size_t> head = {};	// next slot the consumer reads.  atomic only so size() can be read from other threads
+
+	MPSCQueue(int capacity)
+	:	cells(capacity),
+		mask(capacity - 1)
+	{
+		if (!ispowerof2(capacity)) throw Common::Exception() << "MPSCQueue capacity must be a power of 2, got " << capacity;
+		for (size_t i = 0; i < cells.size(); ++i) {
+			cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// any thread.  returns false if the queue is full
+	bool push(T const & value) {
+		size_t pos = tail.load(std::memory_order_relaxed);
+		Cell * cell = {};
+		for (;;) {
+			cell = &cells[pos & mask];
+			size_t const seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t const dif = (intptr_t)seq - (intptr_t)pos;
+			if (dif == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+		cell->value = value;
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer thread only.  returns false if the queue is empty
+	bool pop(T & value) {
+		size_t const pos = head.load(std::memory_order_relaxed);
+		auto & cell = cells[pos & mask];
+		size_t const seq = cell.seq.load(std::memory_order_acquire);
+		if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) return false;
+		value = std::move(cell.value);
+		cell.seq.store(pos + mask + 1, std::memory_order_release);
+		head.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// approximate when other threads are pushing / popping
+	size_t size() const {
+		size_t const t = tail.load(std::memory_order_relaxed);
+		size_t const h = head.load(std::memory_order_relaxed);
+		return t > h ? t - h : 0;
+	}
+
+	size_t capacity() const { return cells.size(); }
+};
+
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "NeuralNet/ANN.h"
+#include "NeuralNet/Kernels.h"
+#include "Common/Exception.h"
+#include <vector>
+
+namespace NeuralNet {
+
+/*
+many ANNs with the same layer sizes, evaluated and trained together
+for ensembles, neuroevolution populations, hyperparameter sweeps ... anything with lots of nets too small to vectorize on their own.
+
+everything is interleaved 8 nets at a time, so a Lane holds the same weight / activation of 8 different nets:
+	value[group][row][lane]		for net = 8 * group + lane
+	weights: w[group][i][j][lane]
+that way every net runs the same instruction stream, each on its own inputs, with its own weights, in its own lane.
+
+	MultiANN<float> nets(32, {162, 3});		// or from a vector of ANNs
+	nets.input(n, j) = ...;
+	nets.feedForward();
+	nets.desiredAt(n, i) = ...;
+	nets.calcError();
+	nets.backPropagate();					// each net steps with its own dt[n]
+	auto best = nets.get(n);				// back out to an ANN
+
+layers share their activations and the loss across all nets.
+dense layers only, and no dropout / dilution / batch accumulation, each backPropagate() updates the weights directly.
+*/
+template<typename Real = DefaultReal>
+struct MultiANN {
+	using ANN = NeuralNet::ANN<Real>;
+	using Activation = NeuralNet::Activation<Real>;
+	using ActivationDeriv = NeuralNet::ActivationDeriv<Real>;
+	using Loss = NeuralNet::Loss<Real>;
+	using L = Lanes<Real>;
+	using Lane = typename L::type;
+
+	static constexpr int lanes = 8;
+
+	struct MultiLayer {
+		int sizeIn = {};
+		int sizeOut = {};
+
+		// interleaved, see above.  x has a row for the bias input, always 1
+		std::vector<Real> x, net;		// feed-forward
+		std::vector<Real> w;			// weights, sizeOut x (sizeIn+1) per net
+		std::vector<Real> xErr, netErr;	// back-propagation
+
+		Activation activation;
+		ActivationDeriv activationDeriv;
+
+		int width() const { return sizeIn + 1; }
+	};
+
+	int numNets = {};
+	int numGroups = {};		// numNets / 8 rounded up, the last group's unused lanes just compute zeroes
+
+	std::vector<MultiLayer> layers;
+	std::vector<Real> output, outputError, desired;
+
+	std::vector<Real> dt;	// per net, padded to a whole group
+	Loss loss = Loss::halfSquared();
+
+protected:
+	std::vector<Real> lossScratch;	// one net's output de-interleaved, for the loss functions
+public:
+
+	// 'numNets' freshly initialized nets, same as ANN(layerSizes) for each
+	MultiANN(int numNets_, std::vector<int> const & layerSizes)
+	:	MultiANN(newNets(numNets_, layerSizes))
+	{}
+
+	// pack copies of these nets.  they must all have the same layer sizes, activations and loss
+	MultiANN(std::vector<ANN> const & nets) {
+		if (nets.empty()) throw Common::Exception() << "need at least one net";
+		auto const & first = nets[0];
+		auto const layerSizes = first.getLayerSizes();
+		numNets = (int)nets.size();
+		numGroups = (numNets + lanes - 1) / lanes;
+		loss = first.loss;
+		for (size_t k = 0; k < first.layers.size(); ++k) {
+			auto const & src = first.layers[k];
+			if (src.conv) throw Common::Exception() << "MultiANN is not supported for conv layers";
+			if (src.sparse) throw Common::Exception() << "MultiANN is not supported for sparse layers";
+			auto & layer = layers.emplace_back();
+			layer.sizeIn = layerSizes[k];
+			layer.sizeOut = layerSizes[k+1];
+			layer.x.resize(lanes * numGroups * layer.width());
+			layer.xErr.resize(lanes * numGroups * layer.width());
+			layer.net.resize(lanes * numGroups * layer.sizeOut);
+			layer.netErr.resize(lanes * numGroups * layer.sizeOut);
+			layer.w.resize(lanes * numGroups * layer.sizeOut * layer.width());
+			layer.activation = src.activation;
+			layer.activationDeriv = src.activationDeriv;
+			for (int g = 0; g < numGroups; ++g) {
+				for (int l = 0; l < lanes; ++l) {
+					layer.x[index(g * lanes + l, layer.sizeIn, layer.width())] = 1;
+				}
+			}
+		}
+		output.resize(lanes * numGroups * layerSizes.back());
+		outputError.resize(output.size());
+		desired.resize(output.size());
+		dt.resize(lanes * numGroups);
+		for (int n = 0; n < numNets; ++n) {
+			auto const & nn = nets[n];
+			if (nn.getLayerSizes() != layerSizes) throw Common::Exception() << "net " << n << " has different layer sizes than net 0";
+			if (nn.loss.name != loss.name) throw Common::Exception() << "net " << n << " has loss " << nn.loss.name << " but net 0 has " << loss.name;
+			for (size_t k = 0; k < layers.size(); ++k) {
+				if (nn.layers[k].activation.name != layers[k].activation.name
+					|| nn.layers[k].activationDeriv.name != layers[k].activationDeriv.name
+				) {
+					throw Common::Exception() << "net " << n << " layer " << k << " has different activations than net 0";
+				}
+			}
+			set(n, nn);
+		}
+	}
+
+	// each with its own random weights
+	static std::vector<ANN> newNets(int numNets_, std::vector<int> const & layerSizes) {
+		std::vector<ANN> nets;
+		for (int n = 0; n < numNets_; ++n) {
+			nets.emplace_back(layerSizes);
+		}
+		return nets;
+	}
+
+	// offset of row 'i' of net 'n' in a value 'rows' tall
+	static int index(int n, int i, int rows) {
+		return lanes * (rows * (n / lanes) + i) + n % lanes;
+	}
+	// offset of weight (i,j) of net 'n'
+	int weightIndex(MultiLayer const & layer, int n, int i, int j) const {
+		return lanes * ((layer.sizeOut * (n / lanes) + i) * layer.width() + j) + n % lanes;
+	}
+
+	int inputSize() const { return layers.front().sizeIn; }
+	int outputSize() const { return layers.back().sizeOut; }
+
+	Real & input(int n, int j) { return layers[0].x[index(n, j, layers[0].width())]; }
+	Real & outputAt(int n, int i) { return output[index(n, i, outputSize())]; }
+	Real & outputErrorAt(int n, int i) { return outputError[index(n, i, outputSize())]; }
+	Real & desiredAt(int n, int i) { return desired[index(n, i, outputSize())]; }
+	Real & weight(int k, int n, int i, int j) { return layers[k].w[weightIndex(layers[k], n, i, j)]; }
+
+	// copy net n's weights and dt in
+	void set(int n, ANN const & nn) {
+		for (size_t k = 0; k < layers.size(); ++k) {
+			auto & layer = layers[k];
+			auto const & w = nn.layers[k].w;
+			for (int i = 0; i < layer.sizeOut; ++i) {
+				for (int j = 0; j < layer.width(); ++j) {
+					layer.w[weightIndex(layer, n, i, j)] = w[i][j];
+				}
+			}
+		}
+		dt[n] = nn.dt;
+	}
+
+	// net n as its own ANN
+	ANN get(int n) const {
+		std::vector<int> layerSizes = {inputSize()};
+		for (auto const & layer : layers) layerSizes.push_back(layer.sizeOut);
+		ANN nn(layerSizes);
+		for (size_t k = 0; k < layers.size(); ++k) {
+			auto const & layer = layers[k];
+			auto & dst = nn.layers[k];
+			for (int i = 0; i < layer.sizeOut; ++i) {
+				for (int j = 0; j < layer.width(); ++j) {
+					dst.w[i][j] = layer.w[weightIndex(layer, n, i, j)];
+				}
+			}
+			dst.activation = layer.activation;
+			dst.activationDeriv = layer.activationDeriv;
+		}
+		nn.loss = loss;
+		nn.dt = dt[n];
+		return nn;
+	}
+
+	void setLoss(std::string const & name) {
+		loss = Loss::get(name);
+		if (loss.fusedOutput) {
+			layers.back().activation = Activation::get("identity");
+			layers.back().activationDeriv = ActivationDeriv::get("one");
+		}
+	}
+
+	void feedForward() {
+		int const numLayers = (int)layers.size();
+		for (int k = 0; k < numLayers; ++k) {
+			auto & layer = layers[k];
+			auto & y = k == numLayers-1 ? output : layers[k+1].x;
+			int const width = layer.width();
+			int const height = layer.sizeOut;
+			for (int g = 0; g < numGroups; ++g) {
+				auto const x = layer.x.data() + lanes * width * g;
+				auto const net = layer.net.data() + lanes * height * g;
+				auto wij = layer.w.data() + lanes * width * height * g;
+				for (int i = 0; i < height; ++i) {
+					// two accumulators so the adds don't all wait on each other
+					Lane acc0 = L::zero(), acc1 = L::zero();
+					int j = 0;
+					for (; j + 1 < width; j += 2, wij += 2 * lanes) {
+						L::madd(acc0, L::load(wij), L::load(x + lanes * j));
+						L::madd(acc1, L::load(wij + lanes), L::load(x + lanes * (j+1)));
+					}
+					for (; j < width; ++j, wij += lanes) {
+						L::madd(acc0, L::load(wij), L::load(x + lanes * j));
+					}
+					L::store(net + lanes * i, L::add(acc0, acc1));
+				}
+			}
+			// y's bias row (if it's the next layer's x) sits past 'height' rows in each group, so it's left alone
+			auto const & activation = layer.activation.f;
+			int const yRows = k == numLayers-1 ? height : height + 1;
+			for (int g = 0; g < numGroups; ++g) {
+				auto const net = layer.net.data() + lanes * height * g;
+				auto const yg = y.data() + lanes * yRows * g;
+				for (int i = 0; i < lanes * height; ++i) {
+					yg[i] = activation(net[i]);
+				}
+			}
+		}
+		if (loss.outputTransform) {
+			lossScratch.resize(outputSize());
+			auto const y = lossScratch.data();
+			for (int n = 0; n < numNets; ++n) {
+				for (int i = 0; i < outputSize(); ++i) y[i] = outputAt(n, i);
+				loss.outputTransform(y, outputSize());
+				for (int i = 0; i < outputSize(); ++i) outputAt(n, i) = y[i];
+			}
+		}
+	}
+
+	// fills outputError, returns each net's loss
+	std::vector<Real> calcError() {
+		int const size = outputSize();
+		std::vector<Real> errors(numNets);
+		lossScratch.resize(3 * size);
+		auto const y = lossScratch.data();
+		auto const d = y + size;
+		auto const yErr = d + size;
+		for (int n = 0; n < numNets; ++n) {
+			for (int i = 0; i < size; ++i) {
+				y[i] = outputAt(n, i);
+				d[i] = desiredAt(n, i);
+			}
+			errors[n] = loss.f(y, d, yErr, size);
+			for (int i = 0; i < size; ++i) {
+				outputErrorAt(n, i) = yErr[i];
+			}
+		}
+		return errors;
+	}
+
+	// w += dt[n] * netErr x, xErr = netErr w with the pre-update weights, each net on its own
+	void backPropagate() {
+		int const numLayers = (int)layers.size();
+		for (int k = numLayers-1; k >= 0; --k) {
+			auto & layer = layers[k];
+			int const width = layer.width();
+			int const height = layer.sizeOut;
+			int const yRows = k == numLayers-1 ? height : height + 1;
+			auto const & y = k == numLayers-1 ? output : layers[k+1].x;
+			auto const & yErr = k == numLayers-1 ? outputError : layers[k+1].xErr;
+			auto const & activationDeriv = layer.activationDeriv.f;
+			for (int g = 0; g < numGroups; ++g) {
+				auto const net = layer.net.data() + lanes * height * g;
+				auto const neterr = layer.netErr.data() + lanes * height * g;
+				auto const yg = y.data() + lanes * yRows * g;
+				auto const yerrg = yErr.data() + lanes * yRows * g;
+				for (int i = 0; i < lanes * height; ++i) {
+					neterr[i] = yerrg[i] * activationDeriv(net[i], yg[i]);
+				}
+			}
+			for (int g = 0; g < numGroups; ++g) {
+				auto const x = layer.x.data() + lanes * width * g;
+				auto const xerr = layer.xErr.data() + lanes * width * g;
+				auto const neterr = layer.netErr.data() + lanes * height * g;
+				auto const dtg = L::load(dt.data() + lanes * g);
+				std::fill(xerr, xerr + lanes * width, Real());
+				auto wij = layer.w.data() + lanes * width * height * g;
+				for (int i = 0; i < height; ++i) {
+					auto const neterri = L::load(neterr + lanes * i);
+					auto const neterridt = L::mul(neterri, dtg);
+					for (int j = 0; j < width; ++j, wij += lanes) {
+						auto wj = L::load(wij);
+						auto xerrj = L::load(xerr + lanes * j);
+						L::madd(xerrj, wj, neterri);
+						L::store(xerr + lanes * j, xerrj);
+						L::madd(wj, neterridt, L::load(x + lanes * j));
+						L::store(wij, wj);
+					}
+				}
+				// the bias row's error has nowhere to go
+				std::fill(xerr + lanes * layer.sizeIn, xerr + lanes * width, Real());
+			}
+		}
+	}
+};
+
+}
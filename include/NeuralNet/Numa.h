@@ -0,0 +1,199 @@
+#pragma once
+
+#include "Common/Exception.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <filesystem>
+#include <algorithm>
+#include <exception>
+#include <cstdlib>
+#include <cctype>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace NeuralNet {
+
+/*
+which cpus belong to which NUMA node, and pinning threads to them
+no libnuma: the topology comes from /sys/devices/system/node, and memory is placed by first touch,
+i.e. whatever thread is pinned to a node when it first writes a page gets that page on its node.
+so allocate per-thread buffers, or per-node copies of the weights, from a thread already pinned there.
+
+	auto topology = NeuralNet::NumaTopology::detect();
+	topology.pin(topology.cpuForWorker(i));		// from worker thread i
+
+on a single-node box, NumaTopology::simulate(n), or NEURALNET_NUMA_NODES=n for detect(),
+splits this process' cpus into n nodes, so the placement code paths all run, just without the latency difference.
+
+affinity and /sys are linux only.  elsewhere detect() gives one node with every cpu, pin() and pinToNode() return false,
+so the same code runs unpinned.
+*/
+struct NumaTopology {
+	std::vector<std::vector<int>> nodeCpus;	// nodeCpus[node] = cpu ids
+	bool simulated = false;
+
+	int numNodes() const { return (int)nodeCpus.size(); }
+	bool empty() const { return nodeCpus.empty(); }
+
+	// -1 if the cpu isn't in any node
+	int nodeOfCpu(int cpu) const {
+		for (int node = 0; node < numNodes(); ++node) {
+			auto const & cpus = nodeCpus[node];
+			if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) return node;
+		}
+		return -1;
+	}
+
+	// where the calling thread is running right now
+	int currentNode() const {
+#if defined(__linux__)
+		return nodeOfCpu(sched_getcpu());
+#else
+		return empty() ? -1 : 0;
+#endif
+	}
+
+	// workers go round-robin over nodes, then over each node's cpus
+	// so worker 0 and 1 land on different nodes when there are two
+	int nodeForWorker(int worker) const {
+		return worker % numNodes();
+	}
+	int cpuForWorker(int worker) const {
+		auto const & cpus = nodeCpus[nodeForWorker(worker)];
+		return cpus[(worker / numNodes()) % cpus.size()];
+	}
+
+	// pin the calling thread to one cpu
+	// returns false if the os wouldn't, i.e. the cpu isn't in this process' cgroup
+	static bool pin(int cpu) {
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+		(void)cpu;
+		return false;
+#endif
+	}
+
+	// pin the calling thread to all of a node's cpus
+	bool pinToNode(int node) const {
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : nodeCpus[node]) CPU_SET(cpu, &set);
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+		(void)node;
+		return false;
+#endif
+	}
+
+	// run f() on a thread pinned to 'node' and wait for it, i.e. to first-touch a node's copy of something
+	template<typename F>
+	void runOnNode(int node, F && f) const {
+		std::exception_ptr error;
+		std::thread([&]() {
+			pinToNode(node);
+			try {
+				f();
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}).join();
+		if (error) std::rethrow_exception(error);
+	}
+
+	// the cpus this process may run on, or every cpu off linux
+	static std::vector<int> allowedCpus() {
+		std::vector<int> cpus;
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+				if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+			}
+		}
+#else
+		for (int cpu = 0; cpu < (int)std::thread::hardware_concurrency(); ++cpu) cpus.push_back(cpu);
+#endif
+		if (cpus.empty()) cpus.push_back(0);
+		return cpus;
+	}
+
+	// "0-3,8-11" => {0,1,2,3,8,9,10,11}
+	static std::vector<int> parseCpuList(std::string const & s) {
+		std::vector<int> cpus;
+		std::istringstream ss(s);
+		std::string range;
+		while (std::getline(ss, range, ',')) {
+			if (range.empty() || range == "\n") continue;
+			auto dash = range.find('-');
+			int const first = std::stoi(range.substr(0, dash));
+			int const last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+
+	// split this process' cpus into 'numNodes' contiguous groups
+	// with fewer cpus than nodes, the nodes share them round-robin
+	static NumaTopology simulate(int numNodes) {
+		if (numNodes < 1) throw Common::Exception() << "can't simulate " << numNodes << " NUMA nodes";
+		auto const cpus = allowedCpus();
+		int const n = (int)cpus.size();
+		NumaTopology topology;
+		topology.simulated = true;
+		topology.nodeCpus.resize(numNodes);
+		if (n >= numNodes) {
+			for (int i = 0; i < n; ++i) {
+				topology.nodeCpus[i * numNodes / n].push_back(cpus[i]);
+			}
+		} else {
+			for (int node = 0; node < numNodes; ++node) {
+				topology.nodeCpus[node].push_back(cpus[node % n]);
+			}
+		}
+		return topology;
+	}
+
+	// the nodes in /sys/devices/system/node, restricted to the cpus this process may use
+	// falls back to one node with every allowed cpu
+	static NumaTopology detect() {
+		if (auto env = std::getenv("NEURALNET_NUMA_NODES")) {
+			return simulate(std::atoi(env));
+		}
+		auto const allowed = allowedCpus();
+		NumaTopology topology;
+#if defined(__linux__)
+		std::error_code ec;
+		std::vector<std::pair<int, std::vector<int>>> nodes;
+		for (auto const & entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+			auto const name = entry.path().filename().string();
+			if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit((unsigned char)name[4])) continue;
+			std::ifstream f(entry.path() / "cpulist");
+			std::string line;
+			if (!std::getline(f, line)) continue;
+			std::vector<int> cpus;
+			for (int cpu : parseCpuList(line)) {
+				if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) cpus.push_back(cpu);
+			}
+			if (!cpus.empty()) nodes.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+		}
+		std::sort(nodes.begin(), nodes.end());
+		for (auto & [id, cpus] : nodes) {
+			topology.nodeCpus.push_back(std::move(cpus));
+		}
+#endif
+		if (topology.empty()) topology.nodeCpus.push_back(allowed);
+		return topology;
+	}
+};
+
+}
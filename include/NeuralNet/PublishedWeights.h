@@ -0,0 +1,105 @@
+#pragma once
+
+#include "NeuralNet/ANN.h"
+#include <atomic>
+#include <cstdint>
+
+namespace NeuralNet {
+
+/*
+RCU-style publishing of an ANN's weights from one trainer thread to any number of reader threads.
+
+Two copies of the net: 'current' is the immutable version readers pin, the other is the spare the next version gets written into.
+Readers pin by bumping the version's pin count and re-checking it is still current, so they never wait on the trainer.
+The trainer only writes into the spare once every reader has unpinned it, that's the reclamation.
+If one is still pinned then publish() returns false instead of blocking, and the trainer can try again after its next update.
+
+Readers run the pinned net with their own Batch buffers:
+	auto batch = published.newBatch(1);
+	...
+	{
+		auto pin = published.pin();
+		pin->feedForward(batch);
+	}
+
+Only the weights are published, not activations or any other settings.
+*/
+template<typename Real = DefaultReal>
+struct PublishedWeights {
+	using ANN = NeuralNet::ANN<Real>;
+	using Batch = NeuralNet::Batch<Real>;
+
+	struct Version {
+		ANN nn;
+		uint64_t id = {};
+		std::atomic<int> pins = {};
+
+		Version(ANN const & src) : nn(src) {
+			// readers only feed forward
+			for (auto & layer : nn.layers) {
+				layer.dw = {};
+			}
+		}
+	};
+
+	Version versions[2];
+	std::atomic<int> current = {};
+
+	PublishedWeights(ANN const & src)
+	:	versions{Version(src), Version(src)}
+	{}
+
+	// unpins on destruction
+	struct Pin {
+		Version * version = {};
+
+		Pin(Version * version_) : version(version_) {}
+		Pin(Pin const &) = delete;
+		Pin(Pin && o) : version(o.version) { o.version = {}; }
+		~Pin() {
+			if (version) version->pins.fetch_sub(1, std::memory_order_release);
+		}
+
+		ANN const & operator*() const { return version->nn; }
+		ANN const * operator->() const { return &version->nn; }
+		uint64_t id() const { return version->id; }
+	};
+
+	// reader threads
+	// only retries if a publish() flipped 'current' in between the load and the pin
+	Pin pin() {
+		for (;;) {
+			int const i = current.load(std::memory_order_seq_cst);
+			auto & version = versions[i];
+			version.pins.fetch_add(1, std::memory_order_seq_cst);
+			if (current.load(std::memory_order_seq_cst) == i) return Pin(&version);
+			version.pins.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	Batch newBatch(int size) const {
+		return versions[0].nn.newBatch(size);
+	}
+
+	// trainer thread only
+	// copies src's weights into the spare version and makes it current
+	// returns false, without copying, if a reader still has the spare pinned
+	bool publish(ANN const & src) {
+		int const cur = current.load(std::memory_order_relaxed);
+		int const spare = 1 - cur;
+		auto & version = versions[spare];
+		if (version.pins.load(std::memory_order_seq_cst) != 0) return false;
+
+		version.nn.copyWeightsFrom(src);
+		version.id = versions[cur].id + 1;
+
+		current.store(spare, std::memory_order_seq_cst);
+		return true;
+	}
+
+	uint64_t currentId() const {
+		return versions[current.load()].id;
+	}
+};
+
+}
@@ -2,8 +2,11 @@
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cassert>
 
 #include "NeuralNet/ANN.h"	//only for NeuralNet::random() right now
+#include "NeuralNet/Telemetry.h"
 
 /*
 Controller needs:
@@ -22,6 +25,8 @@ struct QNNEnv {
 	using Real = typename Controller::Real;
 	using State = typename Controller::State;
 	using NN = decltype(Controller::createNeuralNet());
+	using Layer = typename NN::Layer;
+	using Matrix = typename NN::Matrix;
 
 	State state;
 	NN nn;
@@ -31,24 +36,171 @@ struct QNNEnv {
 	Real lambda = .7;
 	Real noise = 0;
 
+	// TD-lambda via per-weight eligibility traces, one per nn.layers[k].w
+	// step cost is independent of how far back the trace reaches
+	// traces step w directly every step: nn.useBatch, nn.dropout and nn.dilution are ignored, as is historySize.
+	// set false for the history replay below, which honors them
+	bool useTraces = true;
+	std::vector<Matrix> traces;
+
+	// TD-lambda the old way: re-feed and backprop the last 'historySize' states every step
+	// only used when useTraces is false, does nothing otherwise
 	std::vector<std::tuple<State, int, Real>> history;
 	int historySize = 10;
 
+	// feed forward only the inputs that changed since the last state, as long as the weights haven't changed since either
+	// i.e. cartpole's one-hot inputs change 2 of 162 between the feeds within a step
+	bool incremental = true;
+	std::vector<Real> lastInput;
+	bool lastInputCurrent = false;	// layer 0's net is from lastInput and the current weights
+	std::vector<int> changedIndexes;
+	std::vector<Real> changedDeltas;
+
 	std::vector<int> actionCount;
+
+	// set with setTelemetry, then step() records into it and run() doesn't print
+	NeuralNet::Telemetry * telemetry = {};
+	struct {
+		int steps = -1;
+		int reward = -1;
+		int tdError = -1;
+		int resets = -1;
+		std::vector<int> actions;
+	} metrics;
+
 	QNNEnv()
 	: nn(Controller::createNeuralNet())
 	{
 		state = Controller::initState();
 		resetActionCount();
+		for (auto const & layer : nn.layers) {
+			traces.emplace_back(layer.w.height(), layer.w.width());
+		}
+	}
+
+	void clearTraces() {
+		for (auto & trace : traces) {
+			std::fill(trace.v.begin(), trace.v.end(), Real());
+		}
+	}
+
+	// e = decay * e + netErr ⊗ x
+	// w += errdt * e
+	// in one pass over the layer's weights
+	static void updateTrace(
+		Layer & layer,
+		Matrix & trace,
+		Real const decay,
+		Real const errdt
+	) {
+		if (layer.sparse) throw Common::Exception() << "eligibility traces not supported for sparse layers, set useTraces = false";
+		// traces are sized in the ctor, if the layer was reshaped since (i.e. setConv) then its old trace means nothing, start over
+		if (trace.height() != layer.w.height() || trace.width() != layer.w.width()) {
+			trace = Matrix(layer.w.height(), layer.w.width());
+		}
+		if (layer.conv) {
+			// shared weights: decay, accumulate the gradient over every position, then step
+			for (auto & e : trace.v) {
+				e *= decay;
+			}
+			NeuralNet::Conv<Real>::backPropagateWeights(
+				NeuralNet::One<Real>(),
+				layer,
+				layer.cols,
+				layer.netErr.v.data(),
+				trace.v.data(),
+				Real(1)
+			);
+			for (size_t i = 0; i < layer.w.v.size(); ++i) {
+				layer.w.v[i] += errdt * trace.v[i];
+			}
+			return;
+		}
+
+		auto const height = layer.w.height();
+		auto const storageWidth = layer.w.storageWidth();
+		assert(trace.storageSize == layer.w.storageSize);
+		auto wij = layer.w.v.data();
+		auto eij = trace.v.data();
+		auto xptr = layer.x.v.data();
+		auto xendptr = xptr + storageWidth;
+		auto neterri = layer.netErr.v.data();
+		auto neterriend = neterri + height;
+		for (; neterri < neterriend; ++neterri) {
+			auto const neterr = neterri[0];
+			for (auto xj = xptr; xj < xendptr;
+				xj += 8,
+				wij += 8,
+				eij += 8
+			) {
+				eij[0] = decay * eij[0] + neterr * xj[0];
+				eij[1] = decay * eij[1] + neterr * xj[1];
+				eij[2] = decay * eij[2] + neterr * xj[2];
+				eij[3] = decay * eij[3] + neterr * xj[3];
+				eij[4] = decay * eij[4] + neterr * xj[4];
+				eij[5] = decay * eij[5] + neterr * xj[5];
+				eij[6] = decay * eij[6] + neterr * xj[6];
+				eij[7] = decay * eij[7] + neterr * xj[7];
+				wij[0] += errdt * eij[0];
+				wij[1] += errdt * eij[1];
+				wij[2] += errdt * eij[2];
+				wij[3] += errdt * eij[3];
+				wij[4] += errdt * eij[4];
+				wij[5] += errdt * eij[5];
+				wij[6] += errdt * eij[6];
+				wij[7] += errdt * eij[7];
+			}
+		}
+	}
+
+	// steps, resets and per-action counters, reward and TD error histograms
+	void setTelemetry(NeuralNet::Telemetry & telemetry_) {
+		telemetry = &telemetry_;
+		metrics.steps = telemetry->counter("steps");
+		metrics.resets = telemetry->counter("resets");
+		metrics.reward = telemetry->histogram("reward");
+		metrics.tdError = telemetry->histogram("tdError");
+		metrics.actions.clear();
+		for (int i = 0; i < nn.output.size; ++i) {
+			metrics.actions.push_back(telemetry->counter("action" + std::to_string(i)));
+		}
 	}
 
 	void resetActionCount() {
 		actionCount = std::vector<int>(nn.output.size);
 	}
 
+	// call after changing nn's weights outside of QNNEnv
+	void weightsChanged() {
+		lastInputCurrent = false;
+	}
+
 	void feedForwardForState(State const & state) {
 		Controller::observe(state, nn);
-		nn.feedForward();
+		if (!incremental || nn.layers[0].conv || nn.layers[0].sparse) {
+			nn.feedForward();
+			return;
+		}
+		auto const & input = nn.input();
+		lastInput.resize(input.size);
+		bool useChanged = lastInputCurrent;
+		changedIndexes.clear();
+		changedDeltas.clear();
+		for (int i = 0; i < input.size; ++i) {
+			if (input[i] == lastInput[i]) continue;
+			if (useChanged) {
+				changedIndexes.push_back(i);
+				changedDeltas.push_back(input[i] - lastInput[i]);
+			}
+			lastInput[i] = input[i];
+		}
+		// past a quarter of the inputs the full gemv is as fast
+		if (useChanged && (int)changedIndexes.size() * 4 <= input.size) {
+			nn.feedForwardChanged(changedIndexes.data(), changedDeltas.data(), (int)changedIndexes.size());
+		} else {
+			nn.feedForward();
+		}
+		lastInputCurrent = true;
 	}
 
 	std::pair<int, Real> determineAction(State const & state, Real noise = 0) {
@@ -87,13 +239,39 @@ struct QNNEnv {
 
 		// restore the inputs & weights to the state before action for backprop's sake
 		feedForwardForState(lastState);
+		Real err = reward + gamma * maxNextQ - lastActionQ;
+		// what we step along is the loss' gradient of that, i.e. Huber clips it
+		Real errGrad = {};
+		{
+			Real const target = reward + gamma * maxNextQ;
+			nn.loss.f(&lastActionQ, &target, &errGrad, 1);
+		}
+
+		if (useTraces) {
+			// outputError = ∂Q(S[t], A[t])/∂output, backprop turns it into ∂Q/∂w per layer
+			// then decay the traces by γλ, add that gradient, and step the weights by α err e
+			for (int i = 0; i < nn.output.size; ++i) {
+				nn.outputError[i] = 0;
+			}
+			nn.outputError[lastAction] = 1;
+			nn.backPropagateError([&](Layer & layer) {
+				updateTrace(
+					layer,
+					traces[&layer - nn.layers.data()],
+					gamma * lambda,
+					alpha * errGrad
+				);
+			}, &lastAction, 1);
+			weightsChanged();
+			return err;
+		}
+
 		// fill in 'outputError' based on state, newstate, reward, etc
 #if 1	// reward only the action taken
 		for (int i = 0; i < nn.output.size; ++i) {
 			nn.outputError[i] = 0;
 		}
-		Real err = reward + gamma * maxNextQ - lastActionQ;
-		nn.outputError[lastAction] = err;
+		nn.outputError[lastAction] = errGrad;
 #endif
 #if 0	// reward all action signals according to their output?
 		for (int i = 0; i < nn.output.size; ++i) {
@@ -103,19 +281,22 @@ struct QNNEnv {
 		}
 #endif
 		// backprop reward -> outputError -> weights
-		nn.backPropagate(alpha);
+		// only the action taken has an error (with the #if 1 above), so only its row of the last layer
+		nn.backPropagate(alpha, &lastAction, 1);
+		weightsChanged();
 
 		if (history.size() > 0) {
 			// can I TD-lambda by accumulating outputError or should I backProp for each history individually?  batch or no batch?
 			for (int i = 0; i < history.size(); ++i) {
-				err *= lambda;
+				errGrad *= lambda;
 				auto [histState, histAction, histActionQ] = history[i];
 				feedForwardForState(histState);
 				for (int j = 0; j < nn.output.size; ++j) {
 					nn.outputError[j] = 0;
 				}
-				nn.outputError[histAction] = err;
-				nn.backPropagate(alpha);
+				nn.outputError[histAction] = errGrad;
+				nn.backPropagate(alpha, &histAction, 1);
+				weightsChanged();
 			}
 		}
 
@@ -146,10 +327,18 @@ struct QNNEnv {
 		auto [reward, reset] = Controller::getReward(newState);
 		// reward = R[t+1]
 
-		applyReward(newState, reward, state, action, actionQ);
+		Real const tdError = applyReward(newState, reward, state, action, actionQ);
+
+		if (telemetry) {
+			telemetry->add(metrics.steps);
+			telemetry->add(metrics.actions[action]);
+			telemetry->record(metrics.reward, (double)reward);
+			telemetry->record(metrics.tdError, (double)tdError);
+			if (reset) telemetry->add(metrics.resets);
+		}
 
 		//TD-lambda: add to history after applyReward (so it doesn't get considered by applyReward)
-		if (historySize > 0) {
+		if (!useTraces && historySize > 0) {
 			history.insert(history.begin(), std::make_tuple(state, action, actionQ));
 			if (history.size() > historySize) {
 				history.resize(historySize);
@@ -162,6 +351,7 @@ struct QNNEnv {
 		// reset condition TODO where to put this ...
 		if (reset) {
 			history.clear();
+			clearTraces();
 			state = Controller::initState();
 		}
 
@@ -184,12 +374,15 @@ struct QNNEnv {
 			auto [reward, reset] = step();
 			avgReward += reward;
 			if (eval >= numEval) {
-				std::cout << "stepIndex="
-					<< stepIndex
-					<< " avgReward=" << (avgReward/(Real)numEval)
-					<< " actionCount=" << actionCount
-					//<< " output=" << nn.output
-					<< std::endl;
+				// with telemetry the writer thread reports instead
+				if (!telemetry) {
+					std::cout << "stepIndex="
+						<< stepIndex
+						<< " avgReward=" << (avgReward/(Real)numEval)
+						<< " actionCount=" << actionCount
+						//<< " output=" << nn.output
+						<< std::endl;
+				}
 				resetActionCount();
 				eval = 0;
 				avgReward = 0;
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "Common/Exception.h"
+#include "NeuralNet/QNNEnv.h"
+#include "NeuralNet/WorkStealingPool.h"
+
+/*
+runs one QNNEnv per hyperparameter configuration (and seed) on every core, and tabulates how each did
+
+	QNNSweep<Problem> sweep;
+	sweep.steps = 100000;
+	QNNSweep<Problem>::Grid grid;
+	grid.alpha = {.01, .1, .5};
+	grid.lambda = {0, .7, .9};
+	auto results = sweep.run(grid.configs());		// or QNNSweep<Problem>::Random{}.configs(20, seed)
+	sweep.writeTable(std::cout, results);
+
+each run gets its own random engine seeded with baseSeed + its index, installed with NeuralNet::UseThreadRandom,
+so its weight init and anything the Controller draws from NeuralNet::random() are the same every time.
+runs go 'checkpointSteps' at a time as tasks on a WorkStealingPool, which keeps every core busy as runs finish or get cut.
+
+early termination: at each checkpoint a run whose average reward so far is below the 'pruneQuantile' of
+every run that already got to that checkpoint stops there (the median stopping rule).
+which runs reached a checkpoint first depends on timing, so with pruning on, which runs get cut can vary between sweeps.
+
+Controller needs the same as QNNEnv, and its static functions must be safe to call from several threads.
+*/
+template<typename Controller>
+struct QNNSweep {
+	using Real = typename Controller::Real;
+	using Env = QNNEnv<Controller>;
+	using Clock = std::chrono::steady_clock;
+
+	// the QNNEnv fields being swept
+	struct Config {
+		double alpha = .1;
+		double gamma = .99;
+		double lambda = .7;
+		double noise = 0;
+		int historySize = 10;		// only used without traces
+		bool useTraces = true;
+
+		void apply(Env & env) const {
+			env.alpha = (Real)alpha;
+			env.gamma = (Real)gamma;
+			env.lambda = (Real)lambda;
+			env.noise = (Real)noise;
+			env.historySize = historySize;
+			env.useTraces = useTraces;
+		}
+	};
+
+	// every combination
+	struct Grid {
+		std::vector<double> alpha = {.1};
+		std::vector<double> gamma = {.99};
+		std::vector<double> lambda = {.7};
+		std::vector<double> noise = {0};
+		std::vector<bool> useTraces = {true};
+		std::vector<int> historySize = {10};	// only swept for useTraces = false, it does nothing with traces
+
+		std::vector<Config> configs(Config const & base = {}) const {
+			std::vector<Config> result;
+			for (auto a : alpha) {
+				for (auto g : gamma) {
+					for (auto l : lambda) {
+						for (auto n : noise) {
+							for (bool t : useTraces) {
+								for (auto h : historySize) {
+									Config c = base;
+									c.alpha = a;
+									c.gamma = g;
+									c.lambda = l;
+									c.noise = n;
+									c.useTraces = t;
+									c.historySize = h;
+									result.push_back(c);
+									if (t) break;	// the rest would be the same run
+								}
+							}
+						}
+					}
+				}
+			}
+			return result;
+		}
+	};
+
+	struct Range {
+		double min = {};
+		double max = {};
+		bool log = false;	// sample uniformly in log space, min must be > 0
+
+		double sample(std::mt19937_64 & engine) const {
+			std::uniform_real_distribution<double> u(0, 1);
+			double const t = u(engine);
+			if (log) return min * std::pow(max / min, t);
+			return min + (max - min) * t;
+		}
+	};
+
+	// independent uniform samples of each
+	struct Random {
+		Range alpha = {.001, 1, true};
+		Range gamma = {.8, .999};
+		Range lambda = {0, 1};
+		Range noise = {1e-6, 1e-2, true};
+		double useTracesFraction = 1;	// of configs with useTraces, the rest replay history
+		int historySizeMin = 1;			// only sampled for useTraces = false
+		int historySizeMax = 100;
+
+		std::vector<Config> configs(int count, uint64_t seed, Config const & base = {}) const {
+			std::mt19937_64 engine(seed);
+			std::vector<Config> result;
+			for (int i = 0; i < count; ++i) {
+				Config c = base;
+				c.alpha = alpha.sample(engine);
+				c.gamma = gamma.sample(engine);
+				c.lambda = lambda.sample(engine);
+				c.noise = noise.sample(engine);
+				c.useTraces = std::uniform_real_distribution<double>(0, 1)(engine) < useTracesFraction;
+				if (!c.useTraces) {
+					c.historySize = std::uniform_int_distribution<int>(historySizeMin, historySizeMax)(engine);
+				}
+				result.push_back(c);
+			}
+			return result;
+		}
+	};
+
+	// one per config, averaged over its seeds
+	struct Result {
+		Config config;
+		int runs = {};
+		int prunedRuns = {};
+		int64_t steps = {};			// total over all its runs
+		double avgReward = {};		// over every step run
+		double finalReward = {};	// over each run's last checkpoint
+		double stepsPerSec = {};	// per core
+	};
+
+	int steps = 100000;				// per run
+	int checkpointSteps = 10000;
+	int seedsPerConfig = 1;
+	uint64_t baseSeed = 1;
+	double pruneQuantile = .5;		// 0 = never cut a run short
+	int pruneMinRuns = 4;			// don't cut until this many runs reached the checkpoint
+	int numThreads = 0;				// 0 = one per core
+	bool verbose = false;			// print each run as it finishes
+
+	std::vector<Result> run(std::vector<Config> const & configs) {
+		if (steps <= 0 || checkpointSteps <= 0 || seedsPerConfig <= 0) throw Common::Exception() << "steps, checkpointSteps and seedsPerConfig must be positive";
+		checkpoints.clear();
+		checkpoints.resize((steps + checkpointSteps - 1) / checkpointSteps);
+
+		std::vector<std::shared_ptr<Run>> runs;
+		for (size_t c = 0; c < configs.size(); ++c) {
+			for (int s = 0; s < seedsPerConfig; ++s) {
+				auto r = std::make_shared<Run>();
+				r->config = (int)c;
+				r->engine.seed(baseSeed + runs.size());
+				runs.push_back(r);
+			}
+		}
+		{
+			NeuralNet::WorkStealingPool pool(numThreads);
+			for (auto const & r : runs) {
+				pool.submit([this, &pool, &configs, r]() { runChunk(pool, configs, r); });
+			}
+			pool.wait();
+		}
+
+		std::vector<Result> results(configs.size());
+		std::vector<double> seconds(configs.size());
+		for (size_t c = 0; c < configs.size(); ++c) {
+			results[c].config = configs[c];
+		}
+		for (auto const & r : runs) {
+			auto & result = results[r->config];
+			++result.runs;
+			if (r->pruned) ++result.prunedRuns;
+			result.steps += r->steps;
+			result.avgReward += r->rewardSum / (double)r->steps;
+			result.finalReward += r->lastReward;
+			seconds[r->config] += r->seconds;
+		}
+		for (size_t c = 0; c < configs.size(); ++c) {
+			auto & result = results[c];
+			result.avgReward /= (double)result.runs;
+			result.finalReward /= (double)result.runs;
+			result.stepsPerSec = seconds[c] > 0 ? (double)result.steps / seconds[c] : 0;
+		}
+		return results;
+	}
+
+	// tab-separated, one row per config, best finalReward first
+	static void writeTable(std::ostream & o, std::vector<Result> results) {
+		std::stable_sort(results.begin(), results.end(), [](Result const & a, Result const & b) {
+			return a.finalReward > b.finalReward;
+		});
+		o << "alpha\tgamma\tlambda\tnoise\thistorySize\tuseTraces\truns\tpruned\tsteps\tavgReward\tfinalReward\tstepsPerSec" << std::endl;
+		for (auto const & r : results) {
+			o << r.config.alpha
+				<< "\t" << r.config.gamma
+				<< "\t" << r.config.lambda
+				<< "\t" << r.config.noise
+				<< "\t" << r.config.historySize
+				<< "\t" << r.config.useTraces
+				<< "\t" << r.runs
+				<< "\t" << r.prunedRuns
+				<< "\t" << r.steps
+				<< "\t" << r.avgReward
+				<< "\t" << r.finalReward
+				<< "\t" << r.stepsPerSec
+				<< std::endl;
+		}
+	}
+
+	static void writeTable(std::string const & path, std::vector<Result> const & results) {
+		std::ofstream f(path);
+		if (!f) throw Common::Exception() << "failed to open " << path;
+		writeTable(f, results);
+	}
+
+protected:
+	struct Run {
+		int config = {};
+		std::mt19937_64 engine;
+		std::unique_ptr<Env> env;	// made on its first chunk, freed when it's done
+		int64_t steps = {};
+		double rewardSum = {};
+		double lastReward = {};		// average over the last checkpoint
+		double seconds = {};
+		bool pruned = false;
+	};
+
+	// checkpoints[i] = every run's average reward so far at the end of its i'th chunk
+	std::mutex checkpointsMutex;
+	std::vector<std::vector<double>> checkpoints;
+	std::mutex printMutex;
+
+	bool shouldPrune(int checkpoint, double score) {
+		std::lock_guard lock(checkpointsMutex);
+		auto & scores = checkpoints[checkpoint];
+		scores.push_back(score);
+		if (pruneQuantile <= 0 || (int)scores.size() < pruneMinRuns) return false;
+		auto sorted = scores;
+		auto const nth = sorted.begin() + std::min<size_t>(sorted.size() - 1, (size_t)(pruneQuantile * (double)sorted.size()));
+		std::nth_element(sorted.begin(), nth, sorted.end());
+		return score < *nth;
+	}
+
+	void runChunk(NeuralNet::WorkStealingPool & pool, std::vector<Config> const & configs, std::shared_ptr<Run> r) {
+		NeuralNet::UseThreadRandom use(r->engine);
+		auto const start = Clock::now();
+		if (!r->env) {
+			r->env = std::make_unique<Env>();
+			configs[r->config].apply(*r->env);
+		}
+		auto & env = *r->env;
+		int const n = (int)std::min<int64_t>(checkpointSteps, steps - r->steps);
+		double sum = {};
+		for (int i = 0; i < n; ++i) {
+			sum += (double)env.step().first;
+		}
+		r->seconds += std::chrono::duration<double>(Clock::now() - start).count();
+		r->steps += n;
+		r->rewardSum += sum;
+		r->lastReward = sum / (double)n;
+
+		int const checkpoint = (int)((r->steps - 1) / checkpointSteps);
+		bool const finished = r->steps >= steps;
+		if (!finished && shouldPrune(checkpoint, r->rewardSum / (double)r->steps)) {
+			r->pruned = true;
+		}
+		if (finished || r->pruned) {
+			r->env.reset();
+			if (verbose) {
+				std::lock_guard lock(printMutex);
+				auto const & c = configs[r->config];
+				std::cout << "alpha=" << c.alpha
+					<< " gamma=" << c.gamma
+					<< " lambda=" << c.lambda
+					<< " noise=" << c.noise
+					<< " historySize=" << c.historySize
+					<< " steps=" << r->steps
+					<< " avgReward=" << r->rewardSum / (double)r->steps
+					<< (r->pruned ? " pruned" : "")
+					<< std::endl;
+			}
+			return;
+		}
+		// the rest waits behind the runs that haven't reached this checkpoint yet, so there's something to compare against when pruning
+		pool.defer([this, &pool, &configs, r]() { runChunk(pool, configs, r); });
+	}
+};
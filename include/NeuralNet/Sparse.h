@@ -0,0 +1,241 @@
+#pragma once
+/*
+sparse weights, for layers pruned down to a fraction of their weights
+set with ANN::setSparse or ANN::prune, after which the layer's w and dw are empty and its weights live in Layer::sparse.
+
+CSR = each row's surviving weights and their column, one at a time
+Block8 = each row's surviving 8-wide column blocks, aligned the same as the dense padding, so every block is one Lanes op.
+	better when whole blocks were pruned (Sparse::prune does that for Block8), worse when the survivors are scattered.
+
+the bias col is just another col, kept as long as it's nonzero.
+memory and time go with the number of stored weights: values, their column indexes, and the same again for dvalues (the batch accumulation).
+*/
+#include "NeuralNet/Kernels.h"
+#include "Common/Exception.h"
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+namespace NeuralNet {
+
+enum class SparseFormat {
+	CSR,
+	Block8,
+};
+
+template<typename Real>
+struct SparseWeights {
+	using L = Lanes<Real>;
+	using Lane = typename L::type;
+
+	SparseFormat format = SparseFormat::CSR;
+	int height = {};
+	int width = {};			// dense width, including the bias col
+	int storageWidth = {};	// dense storage width, Block8 blocks never go past it
+
+	// row i's entries are [rowStart[i], rowStart[i+1])
+	// CSR: one per weight, index = its col
+	// Block8: one per block, index = its first col, values / dvalues hold 8 per block
+	std::vector<int> rowStart;
+	std::vector<int> index;
+	std::vector<Real> values;
+	std::vector<Real> dvalues;
+
+	int blockSize() const { return format == SparseFormat::Block8 ? 8 : 1; }
+	// stored weights, zeros inside kept blocks included
+	int numStored() const { return (int)values.size(); }
+
+	// keeps the nonzero weights of 'w', or for Block8 the blocks with any nonzero weight
+	static SparseWeights fromDense(auto const & w, SparseFormat format) {
+		SparseWeights s;
+		s.format = format;
+		s.height = w.height();
+		s.width = w.width();
+		s.storageWidth = w.storageWidth();
+		s.rowStart.push_back(0);
+		for (int i = 0; i < s.height; ++i) {
+			auto const wi = w.v.data() + s.storageWidth * i;
+			if (format == SparseFormat::Block8) {
+				for (int j = 0; j < s.storageWidth; j += 8) {
+					if (std::none_of(wi + j, wi + j + 8, [](Real x) { return x != Real(); })) continue;
+					s.index.push_back(j);
+					s.values.insert(s.values.end(), wi + j, wi + j + 8);
+				}
+			} else {
+				for (int j = 0; j < s.width; ++j) {
+					if (wi[j] == Real()) continue;
+					s.index.push_back(j);
+					s.values.push_back(wi[j]);
+				}
+			}
+			s.rowStart.push_back((int)s.index.size());
+		}
+		s.dvalues.resize(s.values.size());
+		return s;
+	}
+
+	// w must already be height x width, zeroed
+	void toDense(auto & w) const {
+		int const bs = blockSize();
+		for (int i = 0; i < height; ++i) {
+			auto const wi = w.v.data() + storageWidth * i;
+			for (int e = rowStart[i]; e < rowStart[i+1]; ++e) {
+				for (int l = 0; l < bs; ++l) {
+					wi[index[e] + l] = values[bs * e + l];
+				}
+			}
+		}
+	}
+
+	// net = w x
+	void gemv(Real const * x, Real * net) const {
+		for (int i = 0; i < height; ++i) {
+			int const e0 = rowStart[i];
+			int const e1 = rowStart[i+1];
+			if (format == SparseFormat::Block8) {
+				Lane sum = L::zero();
+				for (int e = e0; e < e1; ++e) {
+					L::madd(sum, L::load(values.data() + 8 * e), L::load(x + index[e]));
+				}
+				net[i] = L::sum(sum);
+			} else {
+				// 4 independent sums, same as the dense kernels don't make one serial add chain
+				Real sum[4] = {};
+				int e = e0;
+				for (; e + 4 <= e1; e += 4) {
+					sum[0] += values[e+0] * x[index[e+0]];
+					sum[1] += values[e+1] * x[index[e+1]];
+					sum[2] += values[e+2] * x[index[e+2]];
+					sum[3] += values[e+3] * x[index[e+3]];
+				}
+				for (; e < e1; ++e) {
+					sum[0] += values[e] * x[index[e]];
+				}
+				net[i] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+			}
+		}
+	}
+
+	// xErr = w^T netErr over the stored weights
+	// xErr has to hold xErrSize+1 rounded up to 8 Reals, the same as a Vector or a Batch row, everything past xErrSize is zeroed after
+	void backwardError(Real const * netErr, Real * xErr, int const xErrSize) const {
+		rows<true, false>(One(), nullptr, netErr, xErr, xErrSize, nullptr, {});
+	}
+
+	// dest += dt netErr x^T * mul, only over the stored weights
+	// dest = values, or dvalues when batching
+	template<typename Mul>
+	void update(Mul const & mul, Real const * x, Real const * netErr, Real * dest, Real const dt) const {
+		rows<false, true>(mul, x, netErr, nullptr, 0, dest, dt);
+	}
+
+	// both in one pass, xErr from the pre-update weights
+	template<typename Mul>
+	void backward(Mul const & mul, Real const * x, Real const * netErr, Real * xErr, int const xErrSize, Real * dest, Real const dt) const {
+		rows<true, true>(mul, x, netErr, xErr, xErrSize, dest, dt);
+	}
+
+	// values += dvalues * mul, dvalues = 0
+	template<typename Mul>
+	void updateBatch(Mul const & mul) {
+		int const bs = blockSize();
+		for (int e = 0; e < (int)index.size(); ++e) {
+			for (int l = 0; l < bs; ++l) {
+				values[bs * e + l] += dvalues[bs * e + l] * mul.f(index[e] + l);
+				dvalues[bs * e + l] = {};
+			}
+		}
+	}
+
+	void clearBatch() {
+		std::fill(dvalues.begin(), dvalues.end(), Real());
+	}
+
+protected:
+	struct One {
+		static constexpr Real f(int) { return Real(1); }
+	};
+
+	template<bool doXErr, bool doUpdate, typename Mul>
+	void rows(Mul const & mul, Real const * x, Real const * netErr, Real * xErr, int const xErrSize, Real * dest, Real const dt) const {
+		// up to the end of the bias col's block
+		int const xErrEnd = (xErrSize + 8) & -8;
+		if constexpr (doXErr) std::memset(xErr, 0, sizeof(Real) * xErrEnd);
+		for (int i = 0; i < height; ++i) {
+			Real const neterr = netErr[i];
+			Real const neterrdt = dt * neterr;
+			int const e0 = rowStart[i];
+			int const e1 = rowStart[i+1];
+			if (format == SparseFormat::Block8) {
+				Lane const neterrLane = L::set(neterr);
+				Lane const neterrdtLane = L::set(neterrdt);
+				for (int e = e0; e < e1; ++e) {
+					int const j = index[e];
+					if constexpr (doXErr) {
+						Lane xerrj = L::load(xErr + j);
+						L::madd(xerrj, L::load(values.data() + 8 * e), neterrLane);
+						L::store(xErr + j, xerrj);
+					}
+					if constexpr (doUpdate) {
+						Lane destj = L::load(dest + 8 * e);
+						L::madd(destj, neterrdtLane, L::mul(L::load(x + j), Kernels<Real>::mulLanes(mul, j)));
+						L::store(dest + 8 * e, destj);
+					}
+				}
+			} else {
+				for (int e = e0; e < e1; ++e) {
+					int const j = index[e];
+					if constexpr (doXErr) xErr[j] += values[e] * neterr;
+					if constexpr (doUpdate) dest[e] += neterrdt * x[j] * mul.f(j);
+				}
+			}
+		}
+		// whatever the bias col and padding put there
+		if constexpr (doXErr) std::fill(xErr + xErrSize, xErr + xErrEnd, Real());
+	}
+};
+
+template<typename Real>
+struct Sparse {
+	// zero the smallest-magnitude 'fraction' of w's weights, not counting the bias col, which is never pruned
+	// CSR prunes single weights, Block8 whole 8-wide blocks by their L2 norm so the survivors pack into few blocks
+	// returns how many weights were zeroed
+	static int prune(auto & w, Real const fraction, SparseFormat format) {
+		if (!(fraction >= 0 && fraction <= 1)) throw Common::Exception() << "prune fraction must be in [0,1]";
+		int const height = w.height();
+		int const biasCol = w.width() - 1;
+		int const storageWidth = w.storageWidth();
+		int const bs = format == SparseFormat::Block8 ? 8 : 1;
+		// (score, first weight) per weight or block.  the fraction is of all of them, already-zero ones go first,
+		// so prune(.5) then prune(.8) leaves 20%
+		std::vector<std::pair<Real, int>> candidates;
+		for (int i = 0; i < height; ++i) {
+			for (int j = 0; j < biasCol; j += bs) {
+				Real score = {};
+				for (int l = 0; l < bs && j + l < biasCol; ++l) {
+					auto const x = w.v[storageWidth * i + j + l];
+					score += x * x;
+				}
+				candidates.emplace_back(score, storageWidth * i + j);
+			}
+		}
+		int const count = std::min<int>((int)candidates.size(), (int)std::floor(fraction * (Real)candidates.size()));
+		if (count <= 0) return 0;
+		std::nth_element(candidates.begin(), candidates.begin() + (count - 1), candidates.end());
+		int zeroed = 0;
+		for (int c = 0; c < count; ++c) {
+			int const k = candidates[c].second;
+			int const j = k % storageWidth;
+			for (int l = 0; l < bs && j + l < biasCol; ++l) {
+				if (w.v[k + l] != Real()) ++zeroed;
+				w.v[k + l] = {};
+			}
+		}
+		return zeroed;
+	}
+};
+
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "NeuralNet/MPSCQueue.h"
+#include "Common/Exception.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+namespace NeuralNet {
+
+/*
+training metrics without I/O in the training loop
+
+counters add up (steps, action counts), histograms summarize samples (reward, TD error, loss).
+recording is a push onto a lock-free MPSCQueue, from any number of threads.  nothing allocates, locks or blocks.
+if the queue is full the sample is dropped and counted in dropped().
+a background thread drains the queue every 'drainPeriod' and every 'interval' writes one CSV row per metric:
+
+	seconds,metric,count,sum,min,max,mean,rate
+	1.000,steps,214332,214332,1,1,1,214332
+	1.000,reward,214332,-44.7,-1,0.001,-0.000208,214332
+
+count = how many add() / record() calls, seconds = since start, rate = sum per second for counters, samples per second for histograms.
+min/max/mean cover the interval, metrics with nothing recorded in it are left out.
+
+	NeuralNet::Telemetry telemetry("train.csv");
+	int const reward = telemetry.histogram("reward");
+	int const steps = telemetry.counter("steps");
+	for (;;) {
+		...
+		telemetry.record(reward, r);
+		telemetry.add(steps);
+	}
+
+register metrics before recording them.  'print' also writes each interval's rows to stdout, from the writer thread.
+*/
+struct Telemetry {
+	using Clock = std::chrono::steady_clock;
+
+	enum class Kind {
+		Counter,
+		Histogram,
+	};
+
+	std::chrono::duration<double> interval = std::chrono::seconds(1);
+	std::chrono::duration<double> drainPeriod = std::chrono::milliseconds(10);
+	bool print = false;
+
+	// path empty = don't write a file, i.e. print only
+	Telemetry(std::string const & path = {}, int capacity = 1 << 17)
+	:	queue(capacity),
+		start(Clock::now())
+	{
+		if (!path.empty()) {
+			file = fopen(path.c_str(), "w");
+			if (!file) throw Common::Exception() << "failed to open " << path;
+			fprintf(file, "seconds,metric,count,sum,min,max,mean,rate\n");
+		}
+		writer = std::thread([this]() { writeLoop(); });
+	}
+
+	Telemetry(Telemetry const &) = delete;
+	Telemetry & operator=(Telemetry const &) = delete;
+
+	// writes whatever is left
+	~Telemetry() {
+		{
+			std::lock_guard lock(mutex);
+			done = true;
+		}
+		cv.notify_all();
+		writer.join();
+		if (file) fclose(file);
+	}
+
+	// returns the id to record with.  the same name gives the same id
+	int counter(std::string const & name) { return addMetric(name, Kind::Counter); }
+	int histogram(std::string const & name) { return addMetric(name, Kind::Histogram); }
+
+	// any thread:
+
+	void add(int metric, double n = 1) { push(metric, n); }
+	void record(int metric, double value) { push(metric, value); }
+
+	size_t dropped() const { return numDropped.load(std::memory_order_relaxed); }
+
+protected:
+	struct Sample {
+		int metric = {};
+		double value = {};
+	};
+
+	struct Metric {
+		std::string name;
+		Kind kind = {};
+		// this interval's
+		size_t count = {};
+		double sum = {};
+		double min = std::numeric_limits<double>::infinity();
+		double max = -std::numeric_limits<double>::infinity();
+	};
+
+	void push(int metric, double value) {
+		if (!queue.push(Sample{metric, value})) {
+			numDropped.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	int addMetric(std::string const & name, Kind kind) {
+		std::lock_guard lock(mutex);
+		for (size_t i = 0; i < metrics.size(); ++i) {
+			if (metrics[i].name != name) continue;
+			if (metrics[i].kind != kind) throw Common::Exception() << "metric " << name << " was already added as a different kind";
+			return (int)i;
+		}
+		metrics.push_back(Metric{name, kind});
+		return (int)metrics.size() - 1;
+	}
+
+	// writer thread:
+
+	void writeLoop() {
+		auto nextWrite = Clock::now() + std::chrono::duration_cast<Clock::duration>(interval);
+		auto lastWrite = Clock::now();
+		std::unique_lock lock(mutex);
+		for (;;) {
+			bool const stopping = cv.wait_for(lock, drainPeriod, [this]() { return done; });
+			drain();
+			auto const now = Clock::now();
+			if (stopping || now >= nextWrite) {
+				write(now, std::chrono::duration<double>(now - lastWrite).count());
+				lastWrite = now;
+				nextWrite = now + std::chrono::duration_cast<Clock::duration>(interval);
+			}
+			if (stopping) return;
+		}
+	}
+
+	// with the mutex held, so metrics doesn't grow under us
+	void drain() {
+		Sample s;
+		while (queue.pop(s)) {
+			if (s.metric < 0 || s.metric >= (int)metrics.size()) continue;
+			auto & m = metrics[s.metric];
+			++m.count;
+			m.sum += s.value;
+			m.min = std::min(m.min, s.value);
+			m.max = std::max(m.max, s.value);
+		}
+	}
+
+	void write(Clock::time_point now, double elapsed) {
+		double const seconds = std::chrono::duration<double>(now - start).count();
+		for (auto & m : metrics) {
+			if (!m.count) continue;
+			double const mean = m.sum / (double)m.count;
+			double const rate = elapsed > 0 ? (m.kind == Kind::Counter ? m.sum : (double)m.count) / elapsed : 0;
+			if (file) {
+				fprintf(file, "%.3f,%s,%zu,%.9g,%.9g,%.9g,%.9g,%.9g\n", seconds, m.name.c_str(), m.count, m.sum, m.min, m.max, mean, rate);
+			}
+			if (print) {
+				printf("%.3f %s count=%zu mean=%.6g min=%.6g max=%.6g rate=%.6g/s\n", seconds, m.name.c_str(), m.count, mean, m.min, m.max, rate);
+			}
+			m.count = {};
+			m.sum = {};
+			m.min = std::numeric_limits<double>::infinity();
+			m.max = -std::numeric_limits<double>::infinity();
+		}
+		if (auto const n = dropped(); n != lastDropped) {
+			if (file) fprintf(file, "%.3f,dropped,%zu,%zu,,,,\n", seconds, n - lastDropped, n - lastDropped);
+			if (print) printf("%.3f dropped=%zu\n", seconds, n - lastDropped);
+			lastDropped = n;
+		}
+		if (file) fflush(file);
+		if (print) fflush(stdout);
+	}
+
+	MPSCQueue<Sample> queue;
+	std::atomic<size_t> numDropped = {};
+	size_t lastDropped = {};
+
+	Clock::time_point start;
+	FILE * file = {};
+	std::vector<Metric> metrics;
+	bool done = false;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread writer;		// last, so everything it reads is constructed before it starts
+};
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+/*
+trainBatch on a worker thread, against a copy of the net, so whoever started it (i.e. a Lua state) keeps running.
+
+	NeuralNet::TrainJob<float> job(nn, inputs, targets, 100, 32);
+	while (!job.done()) {
+		std::cout << job.epochsDone() << " " << job.lastError() << std::endl;
+		... draw, schedule other jobs, etc ...
+	}
+	job.swapInto(nn);
+
+progress is per epoch.  cancel() stops it after the current epoch.
+the inputs and targets are copied too, so the caller can change or free theirs.
+if trainBatch throws, the job is done and error() has the message.
+the worker uses its own random engine seeded with 'seed', so jobs don't share rand() and the same seed gives the same shuffles and dropout.
+*/
+#include "NeuralNet/ANN.h"
+#include "Common/Exception.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdint>
+
+namespace NeuralNet {
+
+template<typename Real = DefaultReal>
+struct TrainJob {
+	using ANN = NeuralNet::ANN<Real>;
+	using Matrix = NeuralNet::Matrix<Real>;
+
+	TrainJob(ANN const & src, Matrix inputs_, Matrix targets_, int epochs_, int batchSize_ = 1, uint64_t seed = 0)
+	:	nn(src),
+		inputs(std::move(inputs_)),
+		targets(std::move(targets_)),
+		epochs(epochs_),
+		batchSize(batchSize_),
+		engine(seed)
+	{
+		// same checks as trainBatch, but here, so they throw on the caller's thread
+		if (inputs.height() != targets.height()) throw Common::Exception() << "got " << inputs.height() << " inputs but " << targets.height() << " targets";
+		if (inputs.width() != nn.layers[0].x.size) throw Common::Exception() << "expected inputs of width " << nn.layers[0].x.size << " but got " << inputs.width();
+		if (targets.width() != nn.output.size) throw Common::Exception() << "expected targets of width " << nn.output.size << " but got " << targets.width();
+		if (batchSize < 1) throw Common::Exception() << "batchSize must be positive";
+		worker = std::thread([this]() { run(); });
+	}
+
+	TrainJob(TrainJob const &) = delete;
+	TrainJob & operator=(TrainJob const &) = delete;
+
+	~TrainJob() {
+		cancel();
+		wait();
+	}
+
+	// any thread:
+
+	bool done() const { return finished.load(std::memory_order_acquire); }
+	int epochsDone() const { return epochCount.load(std::memory_order_acquire); }
+	int totalEpochs() const { return epochs; }
+
+	// the mean error of the last finished epoch, 0 before the first
+	Real lastError() const {
+		std::lock_guard lock(mutex);
+		return errors.empty() ? Real() : errors.back();
+	}
+
+	// each finished epoch's mean error so far
+	std::vector<Real> epochErrors() const {
+		std::lock_guard lock(mutex);
+		return errors;
+	}
+
+	// what trainBatch threw, empty if it didn't
+	std::string error() const {
+		std::lock_guard lock(mutex);
+		return errorMessage;
+	}
+
+	void cancel() { cancelled.store(true, std::memory_order_release); }
+
+	// owner thread only:
+
+	void wait() {
+		if (worker.joinable()) worker.join();
+	}
+
+	// waits, then swaps the trained weights with dst's.  no copies, dst must have the same layer sizes.
+	// afterwards the job holds dst's old weights
+	void swapInto(ANN & dst) {
+		wait();
+		if (dst.getLayerSizes() != nn.getLayerSizes()) throw Common::Exception() << "can't swap weights into a net with different layer sizes";
+		for (size_t k = 0; k < nn.layers.size(); ++k) {
+			auto & src = nn.layers[k];
+			auto & dstLayer = dst.layers[k];
+			if (src.conv.has_value() != dstLayer.conv.has_value()) throw Common::Exception() << "layer " << k << " is conv in one net but not the other";
+			std::swap(src.w, dstLayer.w);
+			std::swap(src.dw, dstLayer.dw);
+			std::swap(src.sparse, dstLayer.sparse);
+		}
+		std::swap(nn.batchCounter, dst.batchCounter);
+	}
+
+	// the net being trained.  only touch it once done()
+	ANN nn;
+
+protected:
+	void run() {
+		NeuralNet::UseThreadRandom use(engine);
+		try {
+			for (int epoch = 0; epoch < epochs; ++epoch) {
+				if (cancelled.load(std::memory_order_acquire)) break;
+				auto const e = nn.trainBatch(inputs, targets, 1, batchSize);
+				{
+					std::lock_guard lock(mutex);
+					errors.push_back(e[0]);
+				}
+				epochCount.fetch_add(1, std::memory_order_release);
+			}
+		} catch (std::exception & e) {
+			std::lock_guard lock(mutex);
+			errorMessage = e.what();
+		}
+		finished.store(true, std::memory_order_release);
+	}
+
+	Matrix inputs, targets;
+	int epochs = {};
+	int batchSize = 1;
+	std::mt19937_64 engine;
+
+	std::atomic<bool> finished = {};
+	std::atomic<bool> cancelled = {};
+	std::atomic<int> epochCount = {};
+
+	mutable std::mutex mutex;
+	std::vector<Real> errors;
+	std::string errorMessage;
+
+	// last, so everything it reads is constructed before it starts
+	std::thread worker;
+};
+
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+#include "NeuralNet/ANN.h"
+
+/*
+QNNEnv but stepping 'size' environments in lockstep
+one batched feed-forward picks every env's action, one batched back-propagation applies every env's TD update
+
+Controller needs the same as QNNEnv, plus optionally:
+	performActions(newStates, states, actions, actionQs)	// step all envs at once
+
+TD updates are one-step only, eligibility traces would need a per-env copy of every weight.
+*/
+template<typename Controller>
+struct VecQNNEnv {
+	using Real = typename Controller::Real;
+	using State = typename Controller::State;
+	using NN = decltype(Controller::createNeuralNet());
+	using Batch = typename NN::Batch;
+
+	NN nn;
+	int size = {};
+
+	std::vector<State> states, newStates;
+	std::vector<int> actions;
+	std::vector<Real> actionQs;
+	std::vector<Real> rewards;
+	std::vector<char> resets;
+
+	// batch = S[t], nextBatch = S[t+1]
+	Batch batch, nextBatch;
+
+	Real alpha = .1;
+	Real gamma = .99;
+	Real noise = 0;
+
+	std::vector<int> actionCount;
+
+	VecQNNEnv(int size_)
+	:	nn(Controller::createNeuralNet()),
+		size(size_),
+		states(size),
+		newStates(size),
+		actions(size),
+		actionQs(size),
+		rewards(size),
+		resets(size),
+		batch(nn.newBatch(size)),
+		nextBatch(nn.newBatch(size))
+	{
+		for (auto & state : states) {
+			state = Controller::initState();
+		}
+		resetActionCount();
+	}
+
+	void resetActionCount() {
+		actionCount = std::vector<int>(nn.output.size);
+	}
+
+	// Controller::observe fills nn.input(), copy that into the batch row
+	void feedForwardForStates(std::vector<State> const & states_, Batch & dst) {
+		auto & input = nn.input();
+		for (int r = 0; r < size; ++r) {
+			Controller::observe(states_[r], nn);
+			std::copy(input.v.data(), input.v.data() + input.size, dst.input()[r].v);
+		}
+		nn.feedForward(dst);
+	}
+
+	void determineActions() {
+		auto const numActions = nn.output.size;
+		for (int r = 0; r < size; ++r) {
+			auto const outputr = batch.output[r];
+			Real bestValue = outputr[0];
+			if (noise) bestValue += noise * NeuralNet::random<Real>();
+			int bestAction = 0;
+			for (int i = 1; i < numActions; ++i) {
+				Real checkValue = outputr[i];
+				if (noise) checkValue += noise * NeuralNet::random<Real>();
+				if (bestValue < checkValue) {
+					bestValue = checkValue;
+					bestAction = i;
+				}
+			}
+			actions[r] = bestAction;
+			actionQs[r] = outputr[bestAction];
+		}
+	}
+
+	void performActions() {
+		if constexpr (requires { Controller::performActions(newStates, states, actions, actionQs); }) {
+			Controller::performActions(newStates, states, actions, actionQs);
+		} else {
+			for (int r = 0; r < size; ++r) {
+				newStates[r] = Controller::performAction(states[r], actions[r], actionQs[r]);
+			}
+		}
+	}
+
+	// returns the mean reward across all envs
+	Real step() {
+		// state = S[t]
+		feedForwardForStates(states, batch);
+		determineActions();
+		for (int r = 0; r < size; ++r) {
+			++actionCount[actions[r]];
+		}
+
+		// newState = S[t+1]
+		performActions();
+
+		Real sumReward = {};
+		for (int r = 0; r < size; ++r) {
+			auto [reward, reset] = Controller::getReward(newStates[r]);
+			rewards[r] = reward;
+			resets[r] = reset;
+			sumReward += reward;
+		}
+
+		// maxNextQ = max(Q(S[t+1], *)), same as QNNEnv::applyReward
+		feedForwardForStates(newStates, nextBatch);
+		auto const numActions = nn.output.size;
+		for (int r = 0; r < size; ++r) {
+			auto const nextOutputr = nextBatch.output[r];
+			Real maxNextQ = nextOutputr[0];
+			for (int i = 1; i < numActions; ++i) {
+				maxNextQ = std::max(maxNextQ, nextOutputr[i]);
+			}
+			auto outputErrorr = batch.outputError[r];
+			for (int i = 0; i < numActions; ++i) {
+				outputErrorr[i] = 0;
+			}
+			// the TD error goes through nn.loss, i.e. Huber clips it
+			Real const target = rewards[r] + gamma * maxNextQ;
+			nn.loss.f(&actionQs[r], &target, &outputErrorr[actions[r]], 1);
+		}
+
+		// batch still holds S[t]'s activations
+		nn.backPropagate(batch, alpha);
+
+		for (int r = 0; r < size; ++r) {
+			states[r] = resets[r] ? Controller::initState() : newStates[r];
+		}
+
+		return sumReward / (Real)size;
+	}
+
+	void runForever() {
+		for (;;) {
+			step();
+		}
+	}
+
+	void run(int maxsteps) {
+		run(maxsteps, maxsteps + 1);
+	}
+
+	void run(int maxsteps, int numEval) {
+		Real avgReward = {};
+		for (int stepIndex = 0, eval = 0; stepIndex < maxsteps; ++stepIndex, ++eval) {
+			avgReward += step();
+			if (eval >= numEval) {
+				std::cout << "stepIndex="
+					<< stepIndex
+					<< " avgReward=" << (avgReward/(Real)numEval)
+					<< " actionCount=" << actionCount
+					<< std::endl;
+				resetActionCount();
+				eval = 0;
+				avgReward = 0;
+			}
+		}
+	}
+};
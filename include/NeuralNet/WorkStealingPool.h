@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+namespace NeuralNet {
+
+/*
+fixed set of worker threads, one task deque each
+a worker pops the newest task off its own deque, and when that's empty steals the oldest off someone else's,
+so uneven tasks (i.e. runs of different lengths, or ones cut short) don't leave cores idle.
+
+	WorkStealingPool pool;			// one worker per core
+	pool.submit([]() { ... });		// from anywhere, including from inside a task
+	pool.defer([]() { ... });		// same, but after everything already queued on that deque
+	pool.wait();					// until every task so far has finished, rethrows the first one that threw
+
+tasks still queued when the pool is destroyed are dropped, so wait() first.
+*/
+struct WorkStealingPool {
+	using Task = std::function<void()>;
+
+	WorkStealingPool(int numWorkers = 0) {
+		if (numWorkers <= 0) numWorkers = std::max<int>(1, (int)std::thread::hardware_concurrency());
+		for (int i = 0; i < numWorkers; ++i) {
+			queues.push_back(std::make_unique<Queue>());
+		}
+		for (int i = 0; i < numWorkers; ++i) {
+			workers.emplace_back([this, i]() { workerLoop(i); });
+		}
+	}
+
+	~WorkStealingPool() {
+		{
+			std::lock_guard lock(mutex);
+			done = true;
+		}
+		cv.notify_all();
+		for (auto & worker : workers) {
+			worker.join();
+		}
+	}
+
+	int numWorkers() const { return (int)workers.size(); }
+
+	// tasks submitted from a worker go on its own deque, others round-robin
+	void submit(Task task) {
+		push(std::move(task), false);
+	}
+
+	// same but behind everything already queued, i.e. the rest of a long task that should let others go first
+	void defer(Task task) {
+		push(std::move(task), true);
+	}
+
+	void wait() {
+		std::unique_lock lock(mutex);
+		idle.wait(lock, [&]() { return pending == 0; });
+		if (error) {
+			auto e = error;
+			error = {};
+			std::rethrow_exception(e);
+		}
+	}
+
+protected:
+	void push(Task task, bool last) {
+		int const q = currentWorker >= 0 && currentPool == this
+			? currentWorker
+			: (int)(nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size());
+		{
+			std::lock_guard lock(mutex);
+			++pending;
+		}
+		{
+			// the owner pops from the back, so the front is last in line
+			std::lock_guard lock(queues[q]->mutex);
+			if (last) {
+				queues[q]->tasks.push_front(std::move(task));
+			} else {
+				queues[q]->tasks.push_back(std::move(task));
+			}
+		}
+		// only counted once it's in a deque, so a worker that sees queued > 0 will find it
+		{
+			std::lock_guard lock(mutex);
+			++queued;
+		}
+		cv.notify_one();
+	}
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> nextQueue = {};
+
+	// guards the counts, 'done' and 'error', and is what idle workers sleep on
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::condition_variable idle;
+	size_t pending = {};		// submitted and not yet finished
+	long queued = {};			// sitting in a deque.  can dip below 0 for a moment if a task is popped before submit() counts it
+	bool done = false;
+	std::exception_ptr error;
+
+	static inline thread_local int currentWorker = -1;
+	static inline thread_local WorkStealingPool * currentPool = {};
+
+	bool popOwn(int i, Task & task) {
+		auto & q = *queues[i];
+		std::lock_guard lock(q.mutex);
+		if (q.tasks.empty()) return false;
+		task = std::move(q.tasks.back());
+		q.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(int i, Task & task) {
+		int const n = (int)queues.size();
+		for (int k = 1; k < n; ++k) {
+			auto & q = *queues[(i + k) % n];
+			std::lock_guard lock(q.mutex);
+			if (q.tasks.empty()) continue;
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+	void workerLoop(int i) {
+		currentWorker = i;
+		currentPool = this;
+		Task task;
+		for (;;) {
+			if (popOwn(i, task) || steal(i, task)) {
+				{
+					std::lock_guard lock(mutex);
+					--queued;
+				}
+				try {
+					task();
+				} catch (...) {
+					std::lock_guard lock(mutex);
+					if (!error) error = std::current_exception();
+				}
+				task = {};
+				std::lock_guard lock(mutex);
+				if (--pending == 0) idle.notify_all();
+				continue;
+			}
+			// nothing to pop or steal: sleep until something is submitted
+			std::unique_lock lock(mutex);
+			cv.wait(lock, [&]() { return done || queued > 0; });
+			if (done) break;
+		}
+	}
+};
+
+}
@@ -1,6 +1,10 @@
 // here's me trying to make c++ automated Lua binding
 #include "NeuralNet/ANN.h"
+#include "NeuralNet/TrainJob.h"
 #include "LuaCxx/Bind.h"
+#include <type_traits>
+#include <cstring>
+#include <memory>
 
 #if !defined(PLATFORM_OSX) // hmm, osx clang c++23 doesn't have <stdfloat> ...
 #include <stdfloat>
@@ -26,6 +30,174 @@ template<> struct LuaCxx::Bind<std::bfloat16_t> { static constexpr std::string_v
 #endif
 #endif
 
+// bulk access for Vector / ThinVector / Matrix
+// one C call per copy instead of one per element
+// these go in the type's metatable, so call them through the type table:
+//	local Vector = NeuralNetLua['NeuralNet::Vector<float>']
+//	Vector.fromTable(v, {1,2,3})
+// or, with the FFI, skip copying altogether:
+//	local p = ffi.cast('float*', Vector.data(v))
+namespace LuaCxx {
+
+template<typename Real> Real * bulkData(NeuralNet::Vector<Real> & o) { return o.v.data(); }
+template<typename Real> int bulkHeight(NeuralNet::Vector<Real> const &) { return 1; }
+template<typename Real> int bulkWidth(NeuralNet::Vector<Real> const & o) { return o.size; }
+template<typename Real> int bulkStride(NeuralNet::Vector<Real> const & o) { return o.storageSize; }
+
+template<typename Real> Real * bulkData(NeuralNet::ThinVector<Real> & o) { return o.v; }
+template<typename Real> int bulkHeight(NeuralNet::ThinVector<Real> const &) { return 1; }
+template<typename Real> int bulkWidth(NeuralNet::ThinVector<Real> const & o) { return o.size; }
+template<typename Real> int bulkStride(NeuralNet::ThinVector<Real> const & o) { return o.storageSize; }
+
+template<typename Real> Real * bulkData(NeuralNet::Matrix<Real> & o) { return o.v.data(); }
+template<typename Real> int bulkHeight(NeuralNet::Matrix<Real> const & o) { return o.height(); }
+template<typename Real> int bulkWidth(NeuralNet::Matrix<Real> const & o) { return o.width(); }
+template<typename Real> int bulkStride(NeuralNet::Matrix<Real> const & o) { return o.storageWidth(); }
+
+inline size_t bulkLen(lua_State * L, int index) {
+#if LUA_VERSION_NUM >= 502
+	return lua_rawlen(L, index);
+#else
+	return lua_objlen(L, index);
+#endif
+}
+
+// vectors are flat tables, matrices are tables of rows
+template<typename Type, typename Real>
+struct BulkAccess {
+	static constexpr bool isMatrix = std::is_same_v<Type, NeuralNet::Matrix<Real>>;
+
+	// Type.toTable(o) = new table of o's values
+	static int mt_toTable(lua_State * L) {
+		auto & o = *lua_getptr<Type>(L, 1);
+		auto const height = bulkHeight(o);
+		auto const width = bulkWidth(o);
+		auto const stride = bulkStride(o);
+		Real const * data = bulkData(o);
+		lua_createtable(L, isMatrix ? height : width, 0);
+		for (int i = 0; i < height; ++i) {
+			if constexpr (isMatrix) lua_createtable(L, width, 0);
+			auto const row = data + stride * i;
+			for (int j = 0; j < width; ++j) {
+				lua_pushnumber(L, (lua_Number)row[j]);
+				lua_rawseti(L, -2, j+1);
+			}
+			if constexpr (isMatrix) lua_rawseti(L, -2, i+1);
+		}
+		return 1;
+	}
+
+	// Type.fromTable(o, t) copies t's values into o.  t has to be the same size as o.
+	static int mt_fromTable(lua_State * L) {
+		auto & o = *lua_getptr<Type>(L, 1);
+		luaL_checktype(L, 2, LUA_TTABLE);
+		auto const height = bulkHeight(o);
+		auto const width = bulkWidth(o);
+		auto const stride = bulkStride(o);
+		Real * data = bulkData(o);
+		if ((int)bulkLen(L, 2) != (isMatrix ? height : width)) {
+			return luaL_error(L, "expected a table of size %d", isMatrix ? height : width);
+		}
+		for (int i = 0; i < height; ++i) {
+			int rowIndex = 2;
+			if constexpr (isMatrix) {
+				lua_rawgeti(L, 2, i+1);
+				if (!lua_istable(L, -1) || (int)bulkLen(L, -1) != width) {
+					return luaL_error(L, "expected row %d to be a table of size %d", i+1, width);
+				}
+				rowIndex = lua_gettop(L);
+			}
+			auto const row = data + stride * i;
+			for (int j = 0; j < width; ++j) {
+				lua_rawgeti(L, rowIndex, j+1);
+				row[j] = (Real)lua_tonumber(L, -1);
+				lua_pop(L, 1);
+			}
+			if constexpr (isMatrix) lua_pop(L, 1);
+		}
+		return 0;
+	}
+
+	// src / dst for copyFrom / copyTo: a lightuserdata, or with LuaJIT a pointer cdata, i.e. ffi.cast('float*', array)
+	// anything else is an arg error, lua_topointer of a table / string / function is Lua's own object, not data
+	// lua_topointer of a cdata is its box, which for a pointer cdata holds the pointer, so that's dereferenced.
+	// an FFI array passed as-is would be read as a pointer, so it has to be cast first.
+	static constexpr int luaTypeCData = 10;	// LuaJIT's LUA_TCDATA, not in its public headers
+
+	static void * toDataPtr(lua_State * L, int index) {
+		int const type = lua_type(L, index);
+		void * p = {};
+		if (type == LUA_TLIGHTUSERDATA) {
+			p = lua_touserdata(L, index);
+		} else if (type == luaTypeCData) {
+			auto box = (void * const *)lua_topointer(L, index);
+			if (box) p = *box;
+		} else {
+			luaL_argerror(L, index, "expected a lightuserdata or an FFI pointer");
+		}
+		if (!p) luaL_argerror(L, index, "expected a non-null pointer");
+		return p;
+	}
+
+	// Type.copyFrom(o, src) / Type.copyTo(o, dst)
+	// src / dst points to height * width packed Reals, i.e. without o's padding
+	static int mt_copyFrom(lua_State * L) {
+		auto & o = *lua_getptr<Type>(L, 1);
+		auto src = (Real const *)toDataPtr(L, 2);
+		auto const width = bulkWidth(o);
+		auto const stride = bulkStride(o);
+		Real * data = bulkData(o);
+		for (int i = 0; i < bulkHeight(o); ++i) {
+			std::memcpy(data + stride * i, src + width * i, sizeof(Real) * width);
+		}
+		return 0;
+	}
+
+	static int mt_copyTo(lua_State * L) {
+		auto & o = *lua_getptr<Type>(L, 1);
+		auto dst = (Real *)toDataPtr(L, 2);
+		auto const width = bulkWidth(o);
+		auto const stride = bulkStride(o);
+		Real const * data = bulkData(o);
+		for (int i = 0; i < bulkHeight(o); ++i) {
+			std::memcpy(dst + width * i, data + stride * i, sizeof(Real) * width);
+		}
+		return 0;
+	}
+
+	// Type.data(o) = lightuserdata of the first element, for ffi.cast
+	// rows are Type.stride(o) elements apart, the padding after each row must stay zero
+	static int mt_data(lua_State * L) {
+		auto & o = *lua_getptr<Type>(L, 1);
+		lua_pushlightuserdata(L, bulkData(o));
+		return 1;
+	}
+
+	static int mt_stride(lua_State * L) {
+		auto & o = *lua_getptr<Type>(L, 1);
+		lua_pushinteger(L, bulkStride(o));
+		return 1;
+	}
+
+	// metatable on top of the stack
+	static void addMethods(lua_State * L) {
+		lua_pushcfunction(L, mt_toTable);
+		lua_setfield(L, -2, "toTable");
+		lua_pushcfunction(L, mt_fromTable);
+		lua_setfield(L, -2, "fromTable");
+		lua_pushcfunction(L, mt_copyFrom);
+		lua_setfield(L, -2, "copyFrom");
+		lua_pushcfunction(L, mt_copyTo);
+		lua_setfield(L, -2, "copyTo");
+		lua_pushcfunction(L, mt_data);
+		lua_setfield(L, -2, "data");
+		lua_pushcfunction(L, mt_stride);
+		lua_setfield(L, -2, "stride");
+	}
+};
+
+}
+
 // info for ANN structs:
 
 template<typename Real>
@@ -35,7 +207,8 @@ struct LuaCxx::Bind<NeuralNet::Vector<Real>>
 		LuaCxx::Bind<NeuralNet::Vector<Real>>,
 		NeuralNet::Vector<Real>,
 		Real
-	>
+	>,
+	public BulkAccess<NeuralNet::Vector<Real>, Real>
 {
 	using Type = NeuralNet::Vector<Real>;
 
@@ -90,7 +263,8 @@ struct LuaCxx::Bind<NeuralNet::ThinVector<Real>>
 		LuaCxx::Bind<NeuralNet::ThinVector<Real>>,
 		NeuralNet::ThinVector<Real>,
 		Real
-	>
+	>,
+	public BulkAccess<NeuralNet::ThinVector<Real>, Real>
 {
 	using Super = BindStructBase<NeuralNet::ThinVector<Real>>;
 	using Type = NeuralNet::ThinVector<Real>;
@@ -143,7 +317,8 @@ struct LuaCxx::Bind<NeuralNet::Matrix<Real>>
 		LuaCxx::Bind<NeuralNet::Matrix<Real>>,
 		NeuralNet::Matrix<Real>,
 		Real
-	>
+	>,
+	public BulkAccess<NeuralNet::Matrix<Real>, Real>
 {
 	using Super = BindStructBase<NeuralNet::Matrix<Real>>;
 	using Type = NeuralNet::Matrix<Real>;
@@ -240,6 +415,26 @@ struct LuaCxx::Bind<NeuralNet::ActivationDeriv<Real>>
 	}
 };
 
+template<typename Real>
+struct LuaCxx::Bind<NeuralNet::Loss<Real>>
+: public BindStructBase<NeuralNet::Loss<Real>> {
+	using Type = NeuralNet::Loss<Real>;
+
+	static constexpr std::string_view strpre = "NeuralNet::Loss<";
+	static constexpr std::string_view strsuf = ">";
+	static constexpr std::string_view mtname = Common::join_v<strpre, LuaCxx::Bind<Real>::mtname, strsuf>;
+
+	static auto & getFields() {
+		static auto field_name = Field<&Type::name>();
+		static auto field_fusedOutput = Field<&Type::fusedOutput>();
+		static std::map<std::string, FieldBase<Type>*> fields = {
+			{"name", &field_name},
+			{"fusedOutput", &field_fusedOutput},
+		};
+		return fields;
+	}
+};
+
 template<typename Real>
 struct LuaCxx::Bind<NeuralNet::Layer<Real>>
 : public BindStructBase<NeuralNet::Layer<Real>> {
@@ -293,6 +488,123 @@ static NeuralNet::Matrix<Real> newMatrix(int h, int w) {
 }
 
 
+// background training jobs, from ANN.trainAsync
+// a plain userdata holding the TrainJob, its own metatable per Real, and __gc cancels and joins it.
+// nothing here blocks but wait and swapInto, so a coroutine can poll it:
+//	while not job:poll() do coroutine.yield() end
+template<typename Real>
+struct TrainJobAccess {
+	using Job = NeuralNet::TrainJob<Real>;
+	using Ptr = std::unique_ptr<Job>;
+
+	static char const * mtname() {
+		static std::string const name = "NeuralNet::TrainJob<" + std::string(LuaCxx::Bind<Real>::mtname) + ">";
+		return name.c_str();
+	}
+
+	static Job & get(lua_State * L, int index) {
+		auto & ptr = *(Ptr*)luaL_checkudata(L, index, mtname());
+		if (!ptr) throw Common::Exception() << "train job was already freed";
+		return *ptr;
+	}
+
+	static void push(lua_State * L, Ptr job) {
+		new(L) Ptr(std::move(job));
+		if (luaL_newmetatable(L, mtname())) {
+			lua_newtable(L);
+			lua_pushcfunction(L, mt_poll);
+			lua_setfield(L, -2, "poll");
+			lua_pushcfunction(L, mt_errors);
+			lua_setfield(L, -2, "errors");
+			lua_pushcfunction(L, mt_cancel);
+			lua_setfield(L, -2, "cancel");
+			lua_pushcfunction(L, mt_wait);
+			lua_setfield(L, -2, "wait");
+			lua_pushcfunction(L, mt_swapInto);
+			lua_setfield(L, -2, "swapInto");
+			lua_setfield(L, -2, "__index");
+			lua_pushcfunction(L, mt_gc);
+			lua_setfield(L, -2, "__gc");
+		}
+		lua_setmetatable(L, -2);
+	}
+
+	// job:poll() = done, epochs done, last epoch's mean error, total epochs
+	static int mt_poll(lua_State * L) {
+		try {
+			auto & job = get(L, 1);
+			// read done first, so a finished job's epoch count and error are final
+			bool const done = job.done();
+			lua_pushboolean(L, done);
+			lua_pushinteger(L, job.epochsDone());
+			lua_pushnumber(L, (lua_Number)job.lastError());
+			lua_pushinteger(L, job.totalEpochs());
+			return 4;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	// job:errors() = table of each finished epoch's mean error
+	static int mt_errors(lua_State * L) {
+		try {
+			auto const errors = get(L, 1).epochErrors();
+			lua_createtable(L, (int)errors.size(), 0);
+			for (size_t i = 0; i < errors.size(); ++i) {
+				lua_pushnumber(L, (lua_Number)errors[i]);
+				lua_rawseti(L, -2, (int)i+1);
+			}
+			return 1;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	// job:cancel() = stop after the current epoch, doesn't wait
+	static int mt_cancel(lua_State * L) {
+		try {
+			get(L, 1).cancel();
+			return 0;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	// job:wait() = blocks until it's done, raises whatever training threw
+	static int mt_wait(lua_State * L) {
+		try {
+			auto & job = get(L, 1);
+			job.wait();
+			auto const error = job.error();
+			if (!error.empty()) throw Common::Exception() << error;
+			return 0;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	// job:swapInto(ann) = waits, then swaps the trained weights into ann in one call, see TrainJob::swapInto
+	static int mt_swapInto(lua_State * L) {
+		try {
+			auto & job = get(L, 1);
+			auto & ann = *LuaCxx::lua_getptr<NeuralNet::ANN<Real>>(L, 2);
+			job.wait();
+			auto const error = job.error();
+			if (!error.empty()) throw Common::Exception() << error;
+			job.swapInto(ann);
+			return 0;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	static int mt_gc(lua_State * L) {
+		auto ptr = (Ptr*)luaL_checkudata(L, 1, mtname());
+		ptr->~Ptr();
+		return 0;
+	}
+};
+
 template<typename Real>
 struct LuaCxx::Bind<NeuralNet::ANN<Real>>
 : public BindStructBase<NeuralNet::ANN<Real>> {
@@ -349,11 +661,17 @@ struct LuaCxx::Bind<NeuralNet::ANN<Real>>
 		static auto field_batchCounter = Field<&Type::batchCounter>();
 		static auto field_dilution = Field<&Type::dilution>();
 		static auto field_dropout = Field<&Type::dropout>();
+		static auto field_loss = Field<&Type::loss>();
+		static auto field_setLoss = Field<&Type::setLoss>();
 		// TODO member functions that return refs
 		//static auto field_input = Field<&Type::input>();
 		//static auto field_inputError = Field<&Type::inputError>();
-		static auto field_feedForward = Field<&Type::feedForward>();
-		static auto field_calcError = Field<&Type::calcError>();
+		static auto field_feedForward = Field<
+			static_cast<void (Type::*)()>(&Type::feedForward)
+		>();
+		static auto field_calcError = Field<
+			static_cast<Real (Type::*)()>(&Type::calcError)
+		>();
 		static auto field_backPropagate = Field<
 			static_cast<void (Type::*)()>(&Type::backPropagate)
 		>();
@@ -383,6 +701,8 @@ struct LuaCxx::Bind<NeuralNet::ANN<Real>>
 			{"batchCounter", &field_batchCounter},
 			{"dilution", &field_dilution},
 			{"dropout", &field_dropout},
+			{"loss", &field_loss},
+			{"setLoss", &field_setLoss},
 			//{"input", &field_input},
 			//{"inputError", &field_inputError},
 			{"feedForward", &field_feedForward},
@@ -399,24 +719,222 @@ struct LuaCxx::Bind<NeuralNet::ANN<Real>>
 
 		return fields;
 	}
+
+	using Matrix = NeuralNet::Matrix<Real>;
+
+	// a NeuralNet::Matrix object or a table of rows, converted once
+	static Matrix toMatrix(lua_State * L, int index, int width) {
+		if (!lua_istable(L, index)) throw Common::Exception() << "expected a matrix or a table of rows";
+		lua_pushliteral(L, LUACXX_BIND_PTRFIELD);
+		lua_rawget(L, index);
+		bool const isObject = !lua_isnil(L, -1);
+		lua_pop(L, 1);
+		if (isObject) return *lua_getptr<Matrix>(L, index);
+
+		int const height = (int)bulkLen(L, index);
+		Matrix m(height, width);
+		for (int i = 0; i < height; ++i) {
+			lua_rawgeti(L, index, i+1);
+			if (!lua_istable(L, -1) || (int)bulkLen(L, -1) != width) {
+				throw Common::Exception() << "expected row " << (i+1) << " to be a table of size " << width;
+			}
+			for (int j = 0; j < width; ++j) {
+				lua_rawgeti(L, -1, j+1);
+				m[i][j] = (Real)lua_tonumber(L, -1);
+				lua_pop(L, 1);
+			}
+			lua_pop(L, 1);
+		}
+		return m;
+	}
+
+	// ANN.trainBatch(ann, inputs, targets, epochs, [batchSize]) = table of each epoch's mean error
+	// the whole loop runs in C++, see ANN::trainBatch
+	static int mt_trainBatch(lua_State * L) {
+		try {
+			auto & ann = *lua_getptr<Type>(L, 1);
+			auto const inputs = toMatrix(L, 2, ann.layers[0].x.size);
+			auto const targets = toMatrix(L, 3, ann.output.size);
+			int const epochs = (int)luaL_checkinteger(L, 4);
+			int const batchSize = (int)luaL_optinteger(L, 5, 1);
+			auto const errors = ann.trainBatch(inputs, targets, epochs, batchSize);
+			lua_createtable(L, (int)errors.size(), 0);
+			for (size_t i = 0; i < errors.size(); ++i) {
+				lua_pushnumber(L, (lua_Number)errors[i]);
+				lua_rawseti(L, -2, (int)i+1);
+			}
+			return 1;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	// ANN.evaluate(ann, inputs, [batchSize]) = NeuralNet::Matrix of outputs, one per row
+	static int mt_evaluate(lua_State * L) {
+		try {
+			auto & ann = *lua_getptr<Type>(L, 1);
+			auto const inputs = toMatrix(L, 2, ann.layers[0].x.size);
+			int const batchSize = (int)luaL_optinteger(L, 3, 0);
+			auto outputs = ann.evaluate(inputs, batchSize);
+			lua_newtable(L);
+			setMT<Matrix>(L);
+			lua_pushliteral(L, LUACXX_BIND_PTRFIELD);
+			new(L) Matrix(std::move(outputs));
+			lua_rawset(L, -3);
+			return 1;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	// ANN.prune(ann, fraction, ['csr' or 'block8']) = number of weights still stored, see ANN::prune
+	static int mt_prune(lua_State * L) {
+		try {
+			auto & ann = *lua_getptr<Type>(L, 1);
+			auto const fraction = (Real)luaL_checknumber(L, 2);
+			std::string const format = luaL_optstring(L, 3, "csr");
+			if (format != "csr" && format != "block8") throw Common::Exception() << "expected format 'csr' or 'block8' but got " << format;
+			lua_pushinteger(L, ann.prune(fraction, format == "block8" ? NeuralNet::SparseFormat::Block8 : NeuralNet::SparseFormat::CSR));
+			return 1;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	// ANN.trainAsync(ann, inputs, targets, epochs, [batchSize], [seed]) = a job training a copy of ann on a worker thread, see TrainJob
+	static int mt_trainAsync(lua_State * L) {
+		try {
+			auto & ann = *lua_getptr<Type>(L, 1);
+			auto inputs = toMatrix(L, 2, ann.layers[0].x.size);
+			auto targets = toMatrix(L, 3, ann.output.size);
+			int const epochs = (int)luaL_checkinteger(L, 4);
+			int const batchSize = (int)luaL_optinteger(L, 5, 1);
+			auto const seed = (uint64_t)luaL_optinteger(L, 6, 0);
+			auto job = std::make_unique<NeuralNet::TrainJob<Real>>(ann, std::move(inputs), std::move(targets), epochs, batchSize, seed);
+			TrainJobAccess<Real>::push(L, std::move(job));
+			return 1;
+		} catch (std::exception & e) {
+			return luaL_error(L, "%s", e.what());
+		}
+	}
+
+	static void addMethods(lua_State * L) {
+		lua_pushcfunction(L, mt_trainAsync);
+		lua_setfield(L, -2, "trainAsync");
+		lua_pushcfunction(L, mt_prune);
+		lua_setfield(L, -2, "prune");
+		lua_pushcfunction(L, mt_trainBatch);
+		lua_setfield(L, -2, "trainBatch");
+		lua_pushcfunction(L, mt_evaluate);
+		lua_setfield(L, -2, "evaluate");
+	}
 };
 
 
+// per-object field cache
+// the generated __index does a getFields() map lookup and wraps member objects in a new table every time,
+// so 'ann.layers[1].w' makes garbage on every access.
+// this wraps __index to keep whatever comes back as a table, function or userdata (member objects and methods)
+// in a table stored in the object under a lightuserdata key, so repeat accesses are one rawget and allocate nothing.
+// only string keys are cached: fields are members whose address doesn't change.
+// integer keys go through IndexAt, i.e. a Matrix row is a ThinVector pointing into w.v,
+// which dangles once w is reallocated (prune, setDense, Checkpoint::load, TrainJob::swapInto), so those are never cached.
+// numbers and other values still go through the original __index every time, and __newindex is untouched.
+static char fieldCacheKey;
+
+static int cachedIndex(lua_State * L) {
+	// stack: self, key
+	bool const cacheable = lua_istable(L, 1) && lua_type(L, 2) == LUA_TSTRING;
+	if (cacheable) {
+		lua_pushlightuserdata(L, &fieldCacheKey);
+		lua_rawget(L, 1);
+		if (lua_istable(L, -1)) {
+			lua_pushvalue(L, 2);
+			lua_rawget(L, -2);
+			if (!lua_isnil(L, -1)) return 1;
+			lua_pop(L, 1);
+		}
+		lua_pop(L, 1);
+	}
+
+	// original __index(self, key)
+	lua_pushvalue(L, lua_upvalueindex(1));
+	if (lua_type(L, -1) == LUA_TFUNCTION) {
+		lua_pushvalue(L, 1);
+		lua_pushvalue(L, 2);
+		lua_call(L, 2, 1);
+	} else {
+		lua_pushvalue(L, 2);
+		lua_gettable(L, -2);
+		lua_remove(L, -2);
+	}
+
+	int const type = lua_type(L, -1);
+	if (cacheable
+		&& (type == LUA_TTABLE || type == LUA_TFUNCTION || type == LUA_TUSERDATA)
+	) {
+		lua_pushlightuserdata(L, &fieldCacheKey);
+		lua_rawget(L, 1);
+		if (!lua_istable(L, -1)) {
+			lua_pop(L, 1);
+			lua_newtable(L);
+			lua_pushlightuserdata(L, &fieldCacheKey);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, 1);
+		}
+		// stack: ..., result, cache
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, -3);
+		lua_rawset(L, -3);
+		lua_pop(L, 1);
+	}
+	return 1;
+}
+
+// metatable on top of the stack
+static void cacheFields(lua_State * L) {
+	lua_getfield(L, -1, "__indexCached");
+	bool const already = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	if (already) return;
+
+	lua_getfield(L, -1, "__index");
+	lua_pushcclosure(L, cachedIndex, 1);
+	lua_setfield(L, -2, "__index");
+	lua_pushboolean(L, 1);
+	lua_setfield(L, -2, "__indexCached");
+}
+
 // if I inline the lambda def then I get "error: use 'template' keyword to treat 'operator ()' as a dependent template name"
 // so I guess it has to sit here outside the loop
 template<typename T>
 constexpr auto buildType(lua_State * L) {
 	using Bind = LuaCxx::Bind<T>;
 	Bind::getMT(L);
+	// C functions that go straight in the metatable
+	if constexpr (requires { Bind::addMethods(L); }) {
+		Bind::addMethods(L);
+	}
+	cacheFields(L);
 	lua_setfield(L, -2, Bind::mtname.data());
 }
 
+// types that aren't in the library table but are reached through fields
+template<typename T>
+constexpr auto cacheFieldsFor(lua_State * L) {
+	LuaCxx::Bind<T>::getMT(L);
+	cacheFields(L);
+	lua_pop(L, 1);
+}
+
 template<typename Real>
 constexpr auto buildTypesForReal(lua_State * L) {
 	{ using T = NeuralNet::ANN<Real>; buildType<T>(L); }
 	{ using T = NeuralNet::Vector<Real>; buildType<T>(L); }
 	{ using T = NeuralNet::ThinVector<Real>; buildType<T>(L); }
 	{ using T = NeuralNet::Matrix<Real>; buildType<T>(L); }
+	{ using T = NeuralNet::Layer<Real>; cacheFieldsFor<T>(L); }
+	{ using T = std::vector<NeuralNet::Layer<Real>>; cacheFieldsFor<T>(L); }
 }
 
 extern "C" {
@@ -1,5 +1,9 @@
 #include "NeuralNet/ANN.h"
+#include "NeuralNet/Autotune.h"
 #include <iostream>
+#include <string>
+#include <cstdlib>
+#include <chrono>
 
 void accuracy() {
 	//NeuralNet::ANN nn{222, 80, 40, 2};
@@ -80,6 +84,12 @@ void performance() {
 		nn.input().v[i] = NeuralNet::random();
 	}
 
+	// opt-in, since it writes its cache file (see Autotune::defaultCachePath): NEURALNET_TEST_AUTOTUNE=1
+	// picks each layer's kernel blocking first, cached after the first run
+	if (auto const env = std::getenv("NEURALNET_TEST_AUTOTUNE"); env && std::string(env) != "0") {
+		std::cout << "autotune timed " << NeuralNet::autotune(nn) << " kernels" << std::endl;
+	}
+
 	int numIter = 10000;
 	Common::timeFunc("feedForward + backPropagate", [&](){
 		for (int i = 0; i < numIter; ++i) {
@@ -97,6 +107,94 @@ void performance() {
 	});
 }
 
+#if defined(__linux__)
+#include "PerfCounters.h"
+#else
+// perf_event_open is linux only, elsewhere just the timing half of PerfCounters
+struct PerfCounters {
+	std::string error = "perf_event_open is linux only";
+	double seconds = {};
+
+	bool anyAvailable() const { return false; }
+	void reset() { seconds = {}; }
+	void start() { startTime = std::chrono::steady_clock::now(); }
+	void stop() { seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count(); }
+	void report(std::ostream & o, std::string const & name, int calls) const {
+		o << name << ": " << (seconds / (double)calls * 1e6) << " us/call" << std::endl;
+	}
+
+protected:
+	std::chrono::steady_clock::time_point startTime;
+};
+#endif
+// per phase: time, and where the counters are allowed, IPC and miss rates
+void counters() {
+	PerfCounters counters;
+	if (!counters.anyAvailable()) {
+		std::cout << "perf counters unavailable (" << counters.error << "), timing only" << std::endl;
+	}
+
+	auto nn = NeuralNet::ANN{222, 80, 40, 2};
+	for (int i = 0; i < nn.input().size; ++i) {
+		nn.input().v[i] = NeuralNet::random();
+	}
+	int numIter = 10000;
+
+	// what the cost model says each phase should take on this core
+	auto const & roof = NeuralNet::Roofline::measured<double>();
+	std::cout << "roofline: " << roof.peakFlops * 1e-9 << " GFLOP/s, " << roof.bandwidth * 1e-9 << " GB/s" << std::endl;
+
+	// times only 'measure', with 'setup' run before each call
+	// 'model' is the phase's modeled cost per call, compared against the time it took
+	auto phase = [&](std::string const & name, auto && setup, auto && measure, auto && model) {
+		counters.reset();
+		for (int i = 0; i < numIter; ++i) {
+			setup();
+			counters.start();
+			measure();
+			counters.stop();
+		}
+		counters.report(std::cout, name, numIter);
+		NeuralNet::Cost const c = model();
+		double const seconds = counters.seconds / (double)numIter;
+		std::cout << "  model: " << c.flops << " flops, " << c.bytes << " bytes, intensity=" << c.intensity()
+			<< ", roofline fraction=" << (seconds > 0 ? roof.time(c) / seconds : 0)
+			<< std::endl;
+	};
+	auto nothing = [](){};
+	auto forward = [&](){ nn.feedForward(); };
+	auto forwardAndError = [&](){
+		nn.feedForward();
+		nn.desired[0] = random();
+		nn.desired[1] = random();
+		nn.calcError();
+	};
+	auto backward = [&](){ nn.backPropagate(); };
+
+	auto forwardCost = [&](){ return nn.cost().forward; };
+	auto backwardCost = [&](){ return nn.cost().backward; };
+
+	phase("feedForward", nothing, forward, forwardCost);
+	phase("backPropagate", forwardAndError, backward, backwardCost);
+
+	nn.dropout = .5;
+	phase("backPropagate dropout", forwardAndError, backward, backwardCost);
+	nn.dropout = 1;
+
+	// accumulate into dw without backPropagate applying it, so updateBatch is timed on its own
+	nn.useBatch = std::numeric_limits<int>::max();
+	phase("backPropagate into batch", forwardAndError, backward, backwardCost);
+	phase("updateBatch", [&](){
+		forwardAndError();
+		nn.backPropagate();
+	}, [&](){
+		nn.updateBatch();
+	}, [&](){
+		return nn.cost().update;
+	});
+	nn.useBatch = 0;
+}
+
 #if 0  // unit tests
 	{
 		static constexpr myint m = 15;
@@ -157,4 +255,5 @@ void performance() {
 int main() {
 	accuracy();
 	performance();
+	counters();
 }
@@ -0,0 +1,198 @@
+#pragma once
+/*
+hardware performance counters around a block of code, via Linux perf_event_open
+each counter is opened on its own, so whichever ones the kernel / container / hypervisor allows get used and the rest read as unavailable.
+counters are scaled by enabled / running time, in case the PMU had to multiplex them.
+
+	PerfCounters counters;
+	for (...) {
+		counters.start();
+		nn.feedForward();
+		counters.stop();		// accumulates
+	}
+	counters.report(std::cout, "feedForward", numIter);
+
+there's no generic FP-ops event, so FP ops are read from a raw event only if NEURALNET_PERF_FP_EVENT is set,
+i.e. NEURALNET_PERF_FP_EVENT=0x1c7 for Intel FP_ARITH_INST_RETIRED.SCALAR_DOUBLE, or 0x3 for AMD Zen's RETIRED_SSE_AVX_FLOPS.
+*/
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct PerfCounters {
+	enum Event {
+		CYCLES,
+		INSTRUCTIONS,
+		L1D_MISSES,
+		LLC_MISSES,
+		LLC_REFERENCES,
+		BRANCH_MISSES,
+		BRANCHES,
+		FP_OPS,
+		NUM_EVENTS,
+	};
+
+	static char const * eventName(int e) {
+		static char const * names[NUM_EVENTS] = {
+			"cycles",
+			"instructions",
+			"L1d misses",
+			"LLC misses",
+			"LLC references",
+			"branch misses",
+			"branches",
+			"FP ops",
+		};
+		return names[e];
+	}
+
+	int fds[NUM_EVENTS];
+	std::string error;		// why the first counter that failed did
+
+	// since the last reset()
+	double counts[NUM_EVENTS] = {};
+	double seconds = {};
+
+	PerfCounters() {
+		for (int e = 0; e < NUM_EVENTS; ++e) {
+			fds[e] = -1;
+			perf_event_attr attr;
+			if (!getAttr(e, attr)) continue;
+			fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+			if (fds[e] < 0 && error.empty()) {
+				error = std::string(eventName(e)) + ": " + std::strerror(errno);
+			}
+		}
+	}
+
+	~PerfCounters() {
+		for (int e = 0; e < NUM_EVENTS; ++e) {
+			if (fds[e] >= 0) close(fds[e]);
+		}
+	}
+
+	PerfCounters(PerfCounters const &) = delete;
+
+	bool available(int e) const { return fds[e] >= 0; }
+	bool anyAvailable() const {
+		for (int e = 0; e < NUM_EVENTS; ++e) {
+			if (available(e)) return true;
+		}
+		return false;
+	}
+
+	void reset() {
+		for (auto & c : counts) c = {};
+		seconds = {};
+	}
+
+	void start() {
+		for (int e = 0; e < NUM_EVENTS; ++e) {
+			if (fds[e] < 0) continue;
+			ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+			ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+		}
+		startTime = std::chrono::steady_clock::now();
+	}
+
+	void stop() {
+		auto const endTime = std::chrono::steady_clock::now();
+		for (int e = 0; e < NUM_EVENTS; ++e) {
+			if (fds[e] < 0) continue;
+			ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+			// value, time enabled, time running
+			uint64_t v[3] = {};
+			if (read(fds[e], v, sizeof(v)) != sizeof(v)) continue;
+			if (v[2]) counts[e] += (double)v[0] * ((double)v[1] / (double)v[2]);
+		}
+		seconds += std::chrono::duration<double>(endTime - startTime).count();
+	}
+
+	// per-call time, then whatever ratios the available counters allow
+	void report(std::ostream & o, std::string const & name, int calls) const {
+		o << name << ": " << (seconds / (double)calls * 1e6) << " us/call";
+		auto const per = [&](int e) { return counts[e] / (double)calls; };
+		if (available(CYCLES)) o << " cycles/call=" << per(CYCLES);
+		if (available(CYCLES) && available(INSTRUCTIONS) && counts[CYCLES] > 0) {
+			o << " IPC=" << counts[INSTRUCTIONS] / counts[CYCLES];
+		}
+		if (available(INSTRUCTIONS) && counts[INSTRUCTIONS] > 0) {
+			auto const perKInstr = [&](int e) { return 1000. * counts[e] / counts[INSTRUCTIONS]; };
+			if (available(L1D_MISSES)) o << " L1d-misses/kinstr=" << perKInstr(L1D_MISSES);
+			if (available(LLC_MISSES)) o << " LLC-misses/kinstr=" << perKInstr(LLC_MISSES);
+			if (available(BRANCH_MISSES)) o << " branch-misses/kinstr=" << perKInstr(BRANCH_MISSES);
+		}
+		if (available(LLC_MISSES) && available(LLC_REFERENCES) && counts[LLC_REFERENCES] > 0) {
+			o << " LLC-miss-rate=" << counts[LLC_MISSES] / counts[LLC_REFERENCES];
+		}
+		if (available(BRANCH_MISSES) && available(BRANCHES) && counts[BRANCHES] > 0) {
+			o << " branch-miss-rate=" << counts[BRANCH_MISSES] / counts[BRANCHES];
+		}
+		if (available(FP_OPS)) {
+			o << " FP-ops/call=" << per(FP_OPS);
+			if (seconds > 0) o << " GFLOP/s=" << counts[FP_OPS] / seconds * 1e-9;
+		}
+		o << std::endl;
+	}
+
+protected:
+	std::chrono::steady_clock::time_point startTime;
+
+	static bool getAttr(int e, perf_event_attr & attr) {
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;	// also what an unprivileged process is allowed, and keeps the ioctls out of the counts
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		auto const cache = [&](uint64_t id, uint64_t op, uint64_t result) {
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = id | (op << 8) | (result << 16);
+		};
+		switch (e) {
+		case CYCLES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			return true;
+		case INSTRUCTIONS:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			return true;
+		case L1D_MISSES:
+			cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+			return true;
+		case LLC_MISSES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			return true;
+		case LLC_REFERENCES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+			return true;
+		case BRANCH_MISSES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			return true;
+		case BRANCHES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+			return true;
+		case FP_OPS:
+			if (auto raw = std::getenv("NEURALNET_PERF_FP_EVENT")) {
+				attr.type = PERF_TYPE_RAW;
+				attr.config = std::strtoull(raw, nullptr, 0);
+				return true;
+			}
+			return false;
+		}
+		return false;
+	}
+};
@@ -1,5 +1,8 @@
 #include "NeuralNet/QNNEnv.h"
+#include "NeuralNet/VecQNNEnv.h"
+#include "NeuralNet/QNNSweep.h"
 #include "NeuralNet/ANN.h"	// QNNEnv incl this?
+#include "NeuralNet/Telemetry.h"
 #include <algorithm>
 
 using real = double;
@@ -32,6 +35,10 @@ std::ostream & operator<<(std::ostream & o, State const & s) {
 		<< "}";
 }
 
+// episode lengths go here instead of stdout, when main() sets it
+NeuralNet::Telemetry * episodeTelemetry = {};
+int episodeLengthMetric = -1;
+
 static constexpr int xBins = 3;
 static constexpr int dtxBins = 3;
 static constexpr int thetaBins = 6;
@@ -66,30 +73,23 @@ struct Problem {
 		return state;
 	}
 
-	static State performAction(
-		State const & state,
-		int action,
-		Real actionQ
-	) {
+	static constexpr real forceMag = 20;
+
+	static real actionForce(int action) {
+		if (action == ACTION_LEFT) return -forceMag;
+		if (action == ACTION_RIGHT) return forceMag;
+		return 0;
+	}
+
+	static void integrate(State & newState, real force) {
 		constexpr real gravity = 9.8;
 		constexpr real massCart = 1;
 		constexpr real massPole = .1;
 		constexpr real totalMass = massPole + massCart;
 		constexpr real length = .5;
 		constexpr real poleMassLength = massPole * length;
-		constexpr real forceMag = 20;
 		constexpr real dt = .02;
 
-//std::cout << "action=" << action << std::endl;
-		real force = 0;
-		if (action == ACTION_LEFT) {
-			force = -forceMag;
-		} else if (action == ACTION_RIGHT) {
-			force = forceMag;
-		}
-
-		State newState = state;
-		
 		real cosTheta = std::cos(newState.theta);
 		real sinTheta = std::sin(newState.theta);
 		real temp = (force + poleMassLength * newState.dt_theta * newState.dt_theta * sinTheta) / totalMass;
@@ -101,12 +101,34 @@ struct Problem {
 		newState.theta += dt * newState.dt_theta;
 		newState.dt_x += dt * dt2_x;
 		newState.dt_theta += dt * dt2_theta;
+	}
 
+	static State performAction(
+		State const & state,
+		int action,
+		Real actionQ
+	) {
+//std::cout << "action=" << action << std::endl;
+		State newState = state;
+		integrate(newState, actionForce(action));
 //std::cout << "step " << state << " => " << newState << std::endl;
-
 		return newState;
 	}
 
+	// batched version for VecQNNEnv: one branch-free pass over every env
+	static void performActions(
+		std::vector<State> & newStates,
+		std::vector<State> const & states,
+		std::vector<int> const & actions,
+		std::vector<Real> const &	// actionQs, unused same as performAction's actionQ
+	) {
+		int const n = (int)states.size();
+		for (int i = 0; i < n; ++i) {
+			newStates[i] = states[i];
+			integrate(newStates[i], forceMag * (real)(actions[i] - ACTION_IDLE));
+		}
+	}
+
 	static std::pair<real, bool> getReward(
 		State const & state
 	) {
@@ -117,10 +139,8 @@ struct Problem {
 		static constexpr int successIterations = 100000;
 		bool success = state.itersUpright > successIterations;
 		bool reset = fail || success;
-		if (reset) {
-			std::cout << state.itersUpright 
-				//<< " w=" << env.nn.layers[0].w
-				<< std::endl;
+		if (reset && episodeTelemetry) {
+			episodeTelemetry->record(episodeLengthMetric, state.itersUpright);
 		}
 		return std::make_pair(fail ? -1. : .001, reset);
 	}
@@ -187,12 +207,41 @@ struct Problem {
 
 int main(int argc, char** argv) {
 	srand(time(nullptr));
+#if 0	// sweep the hyperparameters on every core instead
+	QNNSweep<Problem> sweep;
+	sweep.steps = 1000000;
+	sweep.checkpointSteps = 100000;
+	sweep.seedsPerConfig = 3;
+	sweep.verbose = true;
+	QNNSweep<Problem>::Grid grid;
+	grid.alpha = {.01, .1, .3};
+	grid.gamma = {.9, .99};
+	grid.lambda = {0, .7, .9};
+	grid.noise = {0, 1e-5};
+	auto results = sweep.run(grid.configs());
+	sweep.writeTable(std::cout, results);
+	sweep.writeTable("sweep.txt", results);
+	return 0;
+#endif
+#if 1
 	QNNEnv<Problem> env;
 	env.alpha = .1;
 	env.gamma = .9;
 	env.lambda = .7;
 	env.noise = 1e-5;
-	env.historySize = 10;
+	env.useTraces = true;	// the default.  for the old history replay instead: useTraces = false, historySize = 10
+	// once a second to stdout and cartpole.csv, instead of a line per episode
+	NeuralNet::Telemetry telemetry("cartpole.csv");
+	telemetry.print = true;
+	episodeTelemetry = &telemetry;
+	episodeLengthMetric = telemetry.histogram("episodeLength");
+	env.setTelemetry(telemetry);
+#else	// step 16 carts in lockstep
+	VecQNNEnv<Problem> env(16);
+	env.alpha = .1;
+	env.gamma = .9;
+	env.noise = 1e-5;
+#endif
 
 	//env.run();
 	env.runForever();
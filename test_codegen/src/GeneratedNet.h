@@ -0,0 +1,301 @@
+#pragma once
+// generated by NeuralNet::Codegen, don't edit
+#include <cmath>
+
+namespace GeneratedNet {
+
+using Real = double;
+
+inline constexpr int numLayers = 3;
+inline constexpr int inputSize = 20;
+inline constexpr int outputSize = 4;
+inline constexpr int layerSizes[numLayers+1] = {20, 16, 12, 4};
+
+// layer 0: 20 -> 16, tanh
+// rows are padded to 24, the bias is col 20
+alignas(64) inline constexpr Real w0[16][24] = {
+	{-0.73224671197493474, -0.72718592726760556, -0.097570192310923676, -0.95795154316654596, -0.29820377243416096, 0.82271609582235383, -0.058495735019535089, -0.85114991985766664, 0.13969429740419348, 0.27046243662747238, -0.82109361271069115, 0.11235779824476011, 0.57930393901296728, -0.55673265201320743, -0.16266294128208603, -0.50044415316658108, -0.41627067894555514, 0.60647264433458092, -0.050812388628873051, -0.46012099168103904, -0.42791636929363774},
+	{0.49798156300998464, -0.083750897556795212, -0.38762664652508672, -0.35648179612483089, -0.77365183717370889, -0.76129361426528841, -0.86176209609094778, 0.38952182998269214, 0.29559345035949502, 0.58041106183845104, -0.21495213815883052, 0.059874619476942836, -0.20325897566935225, -0.61928578200088147, 0.19398150076821929, 0.77684062491141836, -0.25878909945987483, -0.92312369864367438, -0.43347023864154266, 0.77060911350101335, -0.47645037401099943},
+	{0.040970110219981981, -0.96095739528036583, 0.013376322418061193, 0.99784061300173654, 0.21740825697870614, 0.86067630857704502, 0.74464500922671539, -0.67586340546512846, 0.59141616201153058, -0.011377435908923261, 0.10157322278472547, 0.45767674465202002, -0.971948650983671, -0.1003978116326617, -0.63350109336217209, -0.88655598459723728, -0.61619417897992923, -0.97549719617244035, -0.83084665297781468, -0.99878408974039345, -0.73166930790374063},
+	{-0.53791830273475005, 0.82252512614143991, 0.15286106160194413, 0.84773838579837113, -0.95121077524936126, 0.52983560310761524, 0.49841840479797384, 0.5271131713395738, 0.97379192077089671, 0.1291187746650504, -0.028885034562606271, -0.5078946956323156, 0.92286373658230869, 0.32190467679168622, 0.082417148184498412, 0.19411673879612468, 0.14415679005558291, 0.37633231263085487, 0.44151386426675754, -0.080887708314515749, 0.27206208844664181},
+	{0.54935629711667255, 0.79380652387958062, 0.34623969468375138, -0.27754347402528945, -0.97724830453404254, -0.71395549903980871, -0.011186738735074475, 0.45739249687330075, 0.56127352143764009, -0.45829810002916671, -0.71861272894166173, 0.54642826113214582, -0.052334030383304531, 0.93345831433585746, 0.7843489321412449, 0.36353263981972272, 0.27833359056663065, 0.75923584193090199, 0.53015652156633486, -0.91362709028780476, 0.73339302890579439},
+	{-0.46327793370758708, 0.90839953863140277, -0.85962951532503418, -0.42468308510339814, -0.17951553108841922, 0.43588007571271659, 0.2966913839098424, 0.1819169229125841, -0.81150210510937537, -0.7978320815683726, -0.53564071709663619, 0.40166285225871823, -0.2928768675471588, -0.0061647442793520968, 0.3303018217336231, 0.32875129520278379, -0.38404227234100941, -0.5510035515036551, 0.60776539483380065, 0.48024315216699232, -0.69643153014085568},
+	{0.57332279045827339, -0.0018099867759945321, -0.47134657659653334, 0.0084401155215578783, -0.013555909424429635, -0.25688768091991598, 0.027820020092456987, -0.54614194977819275, -0.43458869530268107, -0.17966157056603971, -0.75028913868774505, 0.62035958200694319, 0.71217319953097413, 0.74198305163895828, -0.88890214971922044, -0.056791250467441157, 0.42253558918641199, -0.95480001464870057, 0.76567863112161993, 0.31644142699470756, 0.44592231374843894},
+	{-0.26058888496030119, -0.90468263895034107, 0.026419094912440766, 0.22836747484281195, -0.26794506440703236, -0.21055204638559288, 0.38869663203296123, -0.64067485592077533, -0.070466543136191384, 0.18699752011103343, -0.081157279357259582, -0.95311388379437978, -0.035441206203830622, -0.13572354073953263, -0.40610703491190081, -0.81282933786676259, -0.34415714642738371, -0.738805237237248, -0.2747490719988156, 0.65366836306304621, 0.057718373515934562},
+	{-0.93557542326479193, 0.88269039431680341, -0.57937889961357691, -0.35419988362995147, 0.057104311691267284, 0.8518981716599503, 0.1570233060568027, 0.031854128437251994, -0.25070920631764471, -0.45586392376514351, -0.11302495769716747, 0.26382641324461376, -0.02984097217931192, 0.81605110335342945, 0.27720164452045082, 0.16136516173497206, -0.019962342979323089, -0.58191824407725723, -0.57912245196888801, -0.026909774774445894, 0.7486217886511366},
+	{0.82600410604575059, -0.45561853680407183, -0.095093536819670033, 0.12933044732670762, -0.57352433632015476, -0.90382666427695124, 0.42132552473474294, 0.2628837039493408, -0.036898679509260845, 0.22836060596387298, -0.88181096236990886, -0.18013371848549486, 0.50420388772475366, -0.78960804782275718, 0.41048506750731617, -0.83074669183598537, -0.8727977463147758, -0.6289534562256438, 0.67267357791353199, 0.18117001505321584, 0.78243777139122717},
+	{0.90273586521887239, -0.95936561192234082, 0.21390666852568385, 0.0010152655423818491, -0.15349347351264531, 0.47921600374885798, -0.51562494452777696, 0.029721251255898196, 0.013786174050002264, -0.069038988760087849, -0.10095360839466305, -0.71409054118741455, 0.16796520429922079, 0.3226584133078414, -0.143714691114743, -0.045974259860816491, 0.06364568559206063, -0.47833322001691891, 0.81074331559444768, -0.48003812877235863, 0.36909717969489741},
+	{0.26726851284270836, 0.83089188245367351, 0.91023596783509442, 0.57067175191811859, 0.40536773013565242, -0.24083757505204473, -0.04212198799869038, -0.23695985194065849, 0.26069746513878411, 0.3118668250744796, 0.97961911699611193, -0.25449611917562687, 0.53375536857899042, -0.70728348534713015, 0.14243340926478254, -0.53350155115147602, -0.42636799296487016, 0.39826796591119851, 0.60949804309649713, 0.4509423588614454, -0.19406635558038621},
+	{-0.59463808103695803, -0.71884654456397401, -0.16079214525937602, -0.62966938776910686, -0.068284350105865532, -0.31946470356564782, 0.40904801948807967, -0.96662793064734376, -0.069327253013735546, -0.13560994213267563, 0.71920220183427408, 0.21182536820148168, -0.33640618116090837, 0.3164524038783747, -0.87739684988496114, 0.15140405600530382, 0.61408064550397823, 0.83012122261075061, 0.89154108887416728, 0.49178406514579587, -0.84777547483796978},
+	{-0.18422639158808696, 0.61272400155380757, -0.27655835507389293, -0.36668950333630834, 0.27820240484990211, 0.27060140158629364, 0.40911095596566316, 0.97970752936727767, -0.098333767489760526, -0.0338235902616143, 0.78863533929574769, 0.95531865388941761, -0.20105811590119627, -0.56827731996781483, 0.63762645557338971, 0.74885974742333405, 0.63848674912969594, -0.74069630251408158, 0.71390448861639633, -0.80385602620338537, 0.36852805593021287},
+	{-0.49626935968212915, 0.34543531278700024, -0.77490662010603684, 0.40288328301412424, -0.97422264367320222, -0.79776400394251512, 0.84976156787321067, -0.041007424334729259, -0.59829601229555762, -0.26192730900207406, 0.83133063271810048, 0.56920629019855862, -0.51271890166096923, 0.42319937147654896, -0.88151014549599305, -0.015870908139277717, 0.33778245063952728, -0.23544256451323509, -0.50963032720640156, 0.43982669765898752, -0.56083868415283789},
+	{0.3939259490882947, 0.0023613649878813092, -0.59969671770385746, 0.56520171798508567, 0.86467319902010575, -0.31913905410870036, 0.69525317084028715, 0.96916113294238393, -0.25822130613148209, 0.28669266140788019, -0.81822026141443938, 0.49625150672850693, -0.6923557484392493, -0.041748196960222361, 0.23643516352311589, 0.98295665947957511, 0.6096258452442731, 0.32949530202686161, 0.81063138321483663, 0.7540316582695572, -0.13809470888513087},
+};
+
+// layer 1: 16 -> 12, ReLU
+// rows are padded to 24, the bias is col 16
+alignas(64) inline constexpr Real w1[12][24] = {
+	{0., 0.78747826212110072, -0.60378189023614914, 0.98425924357834971, 0.5362457496095292, 0.98076156519076574, 0.45642445973533041, 0., 0., 0., 0.9027502536679648, 0.77213547190818033, 0., 0.51662755103979352, 0.49007941724536885, 0., -0.047678573419128178},
+	{-0.89080689776118005, 0.78211829951327938, 0.56614506191216529, 0., 0., 0., 0., -0.73347320637785929, 0.42964311877431927, 0., 0.88151921769458896, -0.47628422306668339, 0., 0.97863666688437756, 0., -0.48911437521081191, 0.95891398810487938},
+	{0., 0., 0., 0.53019490152223958, -0.68662949728969314, 0.40611860801194655, 0., 0., -0.45833757726483249, 0., -0.69057559460414319, 0., -0.45568029421328926, -0.83410851150625476, 0., -0.97049073586160284, 0.44923855761954434},
+	{0.49067684066001815, 0., 0., 0.66786032174485177, 0., 0., 0.98513599070182534, 0., 0., -0.61072515982549391, -0.65654494212585068, 0., -0.57447330372069416, -0.97449461259659498, 0., 0., 0.92887865643684675},
+	{0., 0.79229084198685396, 0., 0., 0., 0., 0., -0.8246079310851977, 0., 0., 0., 0.5485734814181944, 0.54816163478950108, 0.93380438237967067, -0.67704952517170081, 0.47534062674049982, -0.067747488333021244},
+	{0., 0., 0., 0.79243794573864346, -0.81745085774619719, 0., 0., 0.56933339040581932, 0., 0., 0.42671386511723464, 0., 0.75980721538414708, 0., 0., 0., 0.91926479607550138},
+	{0., 0., 0., -0.46563507476084498, 0.46556732886050134, -0.97144950101398009, 0.58153951775067947, 0.68487819678969308, -0.77339786256436693, 0., 0.62983507073126033, -0.52675122162782606, 0.91004506896295889, -0.8107066516585999, -0.7328533168039415, 0., -0.78996155181356675},
+	{0.51737894917275962, 0., 0., -0.78735754081426901, 0.97854882932450438, -0.55163234861373356, 0., 0., -0.53864596565443801, 0., 0., 0.97959150273819007, 0., 0.53603648403605586, -0.68661156921674937, 0.60947052305738625, -0.61379797701156025},
+	{-0.53244154885417561, -0.41976728053632695, 0., 0.7210020169000011, 0., 0.67674210302268678, 0., 0.69451212042834931, -0.91253323017623256, -0.42333802974393475, -0.95641044688587273, 0., 0., 0.4750155626655721, 0., -0.84593335326828623, 0.83848458398962578},
+	{0., 0., 0.78530327989711135, 0., 0., -0.5405254154291077, 0., 0., -0.83499714078986975, 0., -0.40666505959319743, 0.58021969561997189, 0.61947187775585344, 0., 0., -0.51828577988351165, 0.64194938037223936},
+	{0.91654430687669675, 0., -0.57131005795781009, 0., 0., 0., 0., -0.92960317080664434, 0., 0., -0.89015663077826601, 0., 0., -0.40828425643412947, 0.58175728307152985, 0., -0.40052911746701414},
+	{0., -0.96625897835931052, 0., 0., -0.56759721993483336, 0.52569822759901519, 0., 0., -0.5804920774730058, 0., -0.58049698629410629, 0., 0., 0.88410462353619024, 0., -0.70996273850040503, -0.72093155518636198},
+};
+
+// layer 2: 12 -> 4, identity
+// rows are padded to 16, the bias is col 12
+alignas(64) inline constexpr Real w2[4][16] = {
+	{-0.70450460411108295, 0.18807417747591004, 0.11674844200950973, 0.20199193630046453, 0.3413675569320056, -0.58167898821851605, 0.26239332748606903, 0.83633189174707168, 0.02599410606365038, 0.93052885709214039, 0.2825353865158704, -0.35599813785529977, -0.93500633389427712},
+	{0.96921584537544936, 0.22213288847679236, -0.50724360671647362, -0.17984938477409262, -0.035596160242574837, 0.71080773346842197, -0.84405734826012946, -0.49517984106927704, 0.2062623346415613, 0.4317488110361023, -0.4050904867080668, -0.13329229418868238, 0.34840327550333661},
+	{0.28920696482751396, 0.34155595686365658, 0.89063590387248026, 0.39024464795492508, -0.52406103162373907, 0.95126589457784938, 0.21601608649505843, 0.98776461528432136, 0.009010658028276719, 0.24304722543117974, 0.10817484939680821, 0.094176898951804588, -0.56345875962686676},
+	{-0.63550623250757243, -0.95728376886658073, 0.16891252686678859, 0.042296347138180979, -0.1780917983133995, -0.27972323989590941, -0.34427737168933914, 0.32911061463292102, -0.082021549586399956, 0.052465051540891983, -0.64976102604826913, -0.56890830589256813, 0.81131470521912963},
+};
+
+// y = outputSize Reals from x = inputSize Reals
+inline void forward(Real const * x, Real * y) {
+	alignas(64) Real x0[24] = {};
+	for (int j = 0; j < 20; ++j) x0[j] = x[j];
+	x0[20] = 1;
+	alignas(64) Real h1[24] = {};
+	h1[16] = 1;
+	// layer 0
+	for (int i = 0; i < 16; ++i) {
+		Real acc[8] = {};
+		for (int j = 0; j < 24; j += 8) {
+			for (int l = 0; l < 8; ++l) acc[l] += w0[i][j+l] * x0[j+l];
+		}
+		Real const sum = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+		h1[i] = std::tanh(sum);
+	}
+	alignas(64) Real h2[16] = {};
+	h2[12] = 1;
+	// layer 1
+	{
+		Real const sum = w1[0][16]
+			+ w1[0][1] * h1[1]
+			+ w1[0][2] * h1[2]
+			+ w1[0][3] * h1[3]
+			+ w1[0][4] * h1[4]
+			+ w1[0][5] * h1[5]
+			+ w1[0][6] * h1[6]
+			+ w1[0][10] * h1[10]
+			+ w1[0][11] * h1[11]
+			+ w1[0][13] * h1[13]
+			+ w1[0][14] * h1[14];
+		h2[0] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[1][16]
+			+ w1[1][0] * h1[0]
+			+ w1[1][1] * h1[1]
+			+ w1[1][2] * h1[2]
+			+ w1[1][7] * h1[7]
+			+ w1[1][8] * h1[8]
+			+ w1[1][10] * h1[10]
+			+ w1[1][11] * h1[11]
+			+ w1[1][13] * h1[13]
+			+ w1[1][15] * h1[15];
+		h2[1] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[2][16]
+			+ w1[2][3] * h1[3]
+			+ w1[2][4] * h1[4]
+			+ w1[2][5] * h1[5]
+			+ w1[2][8] * h1[8]
+			+ w1[2][10] * h1[10]
+			+ w1[2][12] * h1[12]
+			+ w1[2][13] * h1[13]
+			+ w1[2][15] * h1[15];
+		h2[2] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[3][16]
+			+ w1[3][0] * h1[0]
+			+ w1[3][3] * h1[3]
+			+ w1[3][6] * h1[6]
+			+ w1[3][9] * h1[9]
+			+ w1[3][10] * h1[10]
+			+ w1[3][12] * h1[12]
+			+ w1[3][13] * h1[13];
+		h2[3] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[4][16]
+			+ w1[4][1] * h1[1]
+			+ w1[4][7] * h1[7]
+			+ w1[4][11] * h1[11]
+			+ w1[4][12] * h1[12]
+			+ w1[4][13] * h1[13]
+			+ w1[4][14] * h1[14]
+			+ w1[4][15] * h1[15];
+		h2[4] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[5][16]
+			+ w1[5][3] * h1[3]
+			+ w1[5][4] * h1[4]
+			+ w1[5][7] * h1[7]
+			+ w1[5][10] * h1[10]
+			+ w1[5][12] * h1[12];
+		h2[5] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[6][16]
+			+ w1[6][3] * h1[3]
+			+ w1[6][4] * h1[4]
+			+ w1[6][5] * h1[5]
+			+ w1[6][6] * h1[6]
+			+ w1[6][7] * h1[7]
+			+ w1[6][8] * h1[8]
+			+ w1[6][10] * h1[10]
+			+ w1[6][11] * h1[11]
+			+ w1[6][12] * h1[12]
+			+ w1[6][13] * h1[13]
+			+ w1[6][14] * h1[14];
+		h2[6] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[7][16]
+			+ w1[7][0] * h1[0]
+			+ w1[7][3] * h1[3]
+			+ w1[7][4] * h1[4]
+			+ w1[7][5] * h1[5]
+			+ w1[7][8] * h1[8]
+			+ w1[7][11] * h1[11]
+			+ w1[7][13] * h1[13]
+			+ w1[7][14] * h1[14]
+			+ w1[7][15] * h1[15];
+		h2[7] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[8][16]
+			+ w1[8][0] * h1[0]
+			+ w1[8][1] * h1[1]
+			+ w1[8][3] * h1[3]
+			+ w1[8][5] * h1[5]
+			+ w1[8][7] * h1[7]
+			+ w1[8][8] * h1[8]
+			+ w1[8][9] * h1[9]
+			+ w1[8][10] * h1[10]
+			+ w1[8][13] * h1[13]
+			+ w1[8][15] * h1[15];
+		h2[8] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[9][16]
+			+ w1[9][2] * h1[2]
+			+ w1[9][5] * h1[5]
+			+ w1[9][8] * h1[8]
+			+ w1[9][10] * h1[10]
+			+ w1[9][11] * h1[11]
+			+ w1[9][12] * h1[12]
+			+ w1[9][15] * h1[15];
+		h2[9] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[10][16]
+			+ w1[10][0] * h1[0]
+			+ w1[10][2] * h1[2]
+			+ w1[10][7] * h1[7]
+			+ w1[10][10] * h1[10]
+			+ w1[10][13] * h1[13]
+			+ w1[10][14] * h1[14];
+		h2[10] = sum < Real(0) ? Real(0) : sum;
+	}
+	{
+		Real const sum = w1[11][16]
+			+ w1[11][1] * h1[1]
+			+ w1[11][4] * h1[4]
+			+ w1[11][5] * h1[5]
+			+ w1[11][8] * h1[8]
+			+ w1[11][10] * h1[10]
+			+ w1[11][13] * h1[13]
+			+ w1[11][15] * h1[15];
+		h2[11] = sum < Real(0) ? Real(0) : sum;
+	}
+	// layer 2
+	{
+		Real const sum = w2[0][12]
+			+ w2[0][0] * h2[0]
+			+ w2[0][1] * h2[1]
+			+ w2[0][2] * h2[2]
+			+ w2[0][3] * h2[3]
+			+ w2[0][4] * h2[4]
+			+ w2[0][5] * h2[5]
+			+ w2[0][6] * h2[6]
+			+ w2[0][7] * h2[7]
+			+ w2[0][8] * h2[8]
+			+ w2[0][9] * h2[9]
+			+ w2[0][10] * h2[10]
+			+ w2[0][11] * h2[11];
+		y[0] = sum;
+	}
+	{
+		Real const sum = w2[1][12]
+			+ w2[1][0] * h2[0]
+			+ w2[1][1] * h2[1]
+			+ w2[1][2] * h2[2]
+			+ w2[1][3] * h2[3]
+			+ w2[1][4] * h2[4]
+			+ w2[1][5] * h2[5]
+			+ w2[1][6] * h2[6]
+			+ w2[1][7] * h2[7]
+			+ w2[1][8] * h2[8]
+			+ w2[1][9] * h2[9]
+			+ w2[1][10] * h2[10]
+			+ w2[1][11] * h2[11];
+		y[1] = sum;
+	}
+	{
+		Real const sum = w2[2][12]
+			+ w2[2][0] * h2[0]
+			+ w2[2][1] * h2[1]
+			+ w2[2][2] * h2[2]
+			+ w2[2][3] * h2[3]
+			+ w2[2][4] * h2[4]
+			+ w2[2][5] * h2[5]
+			+ w2[2][6] * h2[6]
+			+ w2[2][7] * h2[7]
+			+ w2[2][8] * h2[8]
+			+ w2[2][9] * h2[9]
+			+ w2[2][10] * h2[10]
+			+ w2[2][11] * h2[11];
+		y[2] = sum;
+	}
+	{
+		Real const sum = w2[3][12]
+			+ w2[3][0] * h2[0]
+			+ w2[3][1] * h2[1]
+			+ w2[3][2] * h2[2]
+			+ w2[3][3] * h2[3]
+			+ w2[3][4] * h2[4]
+			+ w2[3][5] * h2[5]
+			+ w2[3][6] * h2[6]
+			+ w2[3][7] * h2[7]
+			+ w2[3][8] * h2[8]
+			+ w2[3][9] * h2[9]
+			+ w2[3][10] * h2[10]
+			+ w2[3][11] * h2[11];
+		y[3] = sum;
+	}
+	// softmax
+	Real maxY = y[0];
+	for (int i = 1; i < outputSize; ++i) maxY = y[i] > maxY ? y[i] : maxY;
+	Real sum = {};
+	for (int i = 0; i < outputSize; ++i) {
+		y[i] = std::exp(y[i] - maxY);
+		sum += y[i];
+	}
+	Real const invSum = Real(1) / sum;
+	for (int i = 0; i < outputSize; ++i) y[i] *= invSum;
+}
+
+}
@@ -0,0 +1,79 @@
+#include "NeuralNet/ANN.h"
+#include "NeuralNet/Codegen.h"
+#include "GeneratedNet.h"
+#include <iostream>
+#include <random>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+/*
+checks that GeneratedNet.h, made by NeuralNet::Codegen from makeNet(), gives the same outputs as feedForward()
+if makeNet() or Codegen changes, regenerate it with:
+	test_codegen --write src/GeneratedNet.h
+*/
+
+using Real = double;
+using ANN = NeuralNet::ANN<Real>;
+
+// the same net every time: its own seeded engine for the weights
+// a bit of everything Codegen handles: tanh, ReLU, identity + softmax, a pruned layer, looped and unrolled layers
+ANN makeNet() {
+	std::mt19937_64 engine(1);
+	NeuralNet::UseThreadRandom use(engine);
+	ANN nn{20, 16, 12, 4};
+	nn.layers[0].setActivation("tanh");
+	nn.layers[1].setActivation("ReLU");
+	nn.setLoss("softmaxCrossEntropy");
+	nn.prune(1, .5);
+	return nn;
+}
+
+NeuralNet::Codegen<Real> makeCodegen() {
+	NeuralNet::Codegen<Real> codegen;
+	codegen.name = "GeneratedNet";
+	codegen.unrollLimit = 300;	// so layer 0 (16 x 21) gets the loop and the rest get unrolled
+	return codegen;
+}
+
+int main(int argc, char ** argv) {
+	auto nn = makeNet();
+
+	if (argc >= 2 && std::string(argv[1]) == "--write") {
+		std::string const path = argc >= 3 ? argv[2] : "src/GeneratedNet.h";
+		makeCodegen().write(path, nn);
+		std::cout << "wrote " << path << std::endl;
+		return 0;
+	}
+
+	if (GeneratedNet::inputSize != nn.input().size || GeneratedNet::outputSize != nn.output.size) {
+		std::cerr << "GeneratedNet.h is for a different net, regenerate it" << std::endl;
+		return 1;
+	}
+
+	std::mt19937_64 engine(2);
+	std::uniform_real_distribution<Real> dist(-2, 2);
+	int const numTests = 1000;
+	Real maxDiff = {};
+	for (int t = 0; t < numTests; ++t) {
+		Real x[GeneratedNet::inputSize];
+		for (int j = 0; j < GeneratedNet::inputSize; ++j) {
+			x[j] = dist(engine);
+			nn.input()[j] = x[j];
+		}
+		Real y[GeneratedNet::outputSize];
+		GeneratedNet::forward(x, y);
+		nn.feedForward();
+		for (int i = 0; i < GeneratedNet::outputSize; ++i) {
+			maxDiff = std::max(maxDiff, std::fabs(y[i] - nn.output[i]));
+		}
+	}
+	std::cout << "codegen max difference over " << numTests << " inputs: " << maxDiff << std::endl;
+	// only the summation order differs
+	if (!(maxDiff < 1e-12)) {
+		std::cerr << "FAILED, if makeNet() or Codegen changed then regenerate GeneratedNet.h" << std::endl;
+		return 1;
+	}
+	std::cout << "passed" << std::endl;
+	return 0;
+}
@@ -97,7 +97,7 @@ int main(int argc, char** argv) {
 	srand(time(nullptr));
 	QNNEnv<Problem> env;
 	env.lambda = .1;
-	env.historySize = 100;
+	env.useTraces = true;	// the default.  for the old history replay instead: useTraces = false, historySize = 100
 
 	//env.run(100000, 10000);
 	//env.runForever();